@@ -1,11 +1,14 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <math.h>
 
+#include <algorithm>
 #include <format>
 #include <string>
 #include <memory>
 #include <vector>
 #include <functional>
+#include <unordered_map>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -89,16 +92,394 @@ void make_ortho(matrix mat, int w, int h)
     mat[15] = 1.0f;
 }
 
-bool is_clockwise(std::vector<TPPLPoint> const &points)
+// twice the signed area of the triangle a, b, c, positive if counter-clockwise
+
+double twice_area(TPPLPoint const &a, TPPLPoint const &b, TPPLPoint const &c)
+{
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+//////////////////////////////////////////////////////////////////////
+// whether the segments a-b and c-d touch
+
+bool segments_touch(TPPLPoint const &a, TPPLPoint const &b, TPPLPoint const &c, TPPLPoint const &d)
+{
+    if(std::max(a.x, b.x) < std::min(c.x, d.x) || std::max(c.x, d.x) < std::min(a.x, b.x) ||
+       std::max(a.y, b.y) < std::min(c.y, d.y) || std::max(c.y, d.y) < std::min(a.y, b.y)) {
+        return false;
+    }
+    return twice_area(a, b, c) * twice_area(a, b, d) <= 0 && twice_area(c, d, a) * twice_area(c, d, b) <= 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// whether an edge of the counter-clockwise triangle t has all of the
+// triangle u on or outside its line
+
+bool separates(std::vector<TPPLPoint> const &points, uint32_t const *t, uint32_t const *u)
 {
-    double t = 0;
-    for(size_t i = 0, n = points.size() - 1; i < points.size(); n = i++) {
-        t += (points[i].x - points[n].x) * (points[i].y + points[n].y);
+    for(int i = 0; i < 3; ++i) {
+        TPPLPoint const &a = points[t[i]];
+        TPPLPoint const &b = points[t[(i + 1) % 3]];
+        if(twice_area(a, b, points[u[0]]) <= 0 && twice_area(a, b, points[u[1]]) <= 0 && twice_area(a, b, points[u[2]]) <= 0) {
+            return true;
+        }
     }
-    // log("{}:{}", t, t >= 0 ? "Clockwise" : "Counter-clockwise");
-    return t >= 0;
+    return false;
 }
 
+// whether the counter-clockwise triangles t and u overlap by more than
+// an edge or a corner
+
+bool triangles_overlap(std::vector<TPPLPoint> const &points, uint32_t const *t, uint32_t const *u)
+{
+    return !separates(points, t, u) && !separates(points, u, t);
+}
+
+//////////////////////////////////////////////////////////////////////
+// uniform grid over the edges of the open chain, edge i running from
+// points[i] to points[i + 1]. each edge is listed in the cells it passes
+// through, so a segment is only tested against the edges near it
+
+struct edge_grid
+{
+    static constexpr double cell_size = 32;
+
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+
+    void clear()
+    {
+        cells.clear();
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    // calls f with the key of each cell the segment a-b passes through, a
+    // row at a time, until f returns true. the columns are widened a
+    // little so that rounding can't lose the cell where two segments touch
+
+    template <typename F> static void walk(TPPLPoint const &a, TPPLPoint const &b, F f)
+    {
+        TPPLPoint const &lo = a.y <= b.y ? a : b;
+        TPPLPoint const &hi = a.y <= b.y ? b : a;
+        int64_t first_row = (int64_t)floor(lo.y / cell_size);
+        int64_t last_row = (int64_t)floor(hi.y / cell_size);
+        for(int64_t row = first_row; row <= last_row; ++row) {
+            double x1 = lo.x;
+            double x2 = hi.x;
+            if(row > first_row) {
+                x1 = lo.x + (row * cell_size - lo.y) * (hi.x - lo.x) / (hi.y - lo.y);
+            }
+            if(row < last_row) {
+                x2 = lo.x + ((row + 1) * cell_size - lo.y) * (hi.x - lo.x) / (hi.y - lo.y);
+            }
+            int64_t first_column = (int64_t)floor((std::min(x1, x2) - 1e-3) / cell_size);
+            int64_t last_column = (int64_t)floor((std::max(x1, x2) + 1e-3) / cell_size);
+            for(int64_t column = first_column; column <= last_column; ++column) {
+                if(f(((uint64_t)(uint32_t)row << 32) | (uint32_t)column)) {
+                    return;
+                }
+            }
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////
+
+    void insert(std::vector<TPPLPoint> const &points, uint32_t i)
+    {
+        walk(points[i], points[i + 1], [&](uint64_t key) {
+            cells[key].push_back(i);
+            return false;
+        });
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    // whether the segment from points[p] to points[q] touches any of the
+    // edges i with first <= i < last
+
+    bool crosses(std::vector<TPPLPoint> const &points, size_t p, size_t q, size_t first, size_t last) const
+    {
+        bool found = false;
+        walk(points[p], points[q], [&](uint64_t key) {
+            auto cell = cells.find(key);
+            if(cell != cells.end()) {
+                for(uint32_t i : cell->second) {
+                    if(i >= first && i < last && segments_touch(points[p], points[q], points[i], points[i + 1])) {
+                        found = true;
+                        break;
+                    }
+                }
+            }
+            return found;
+        });
+        return found;
+    }
+};
+
+//////////////////////////////////////////////////////////////////////
+// triangulation of the polygon through all the points so far (closed from
+// the last point back to the first) which is kept up to date as points are
+// appended. appending b after a swaps the closing edge a-c for a-b-c. if
+// both polygons are simple, the triangle a, b, c either has the polygon's
+// winding and lies outside the old polygon, so it is just added, or it
+// lies inside and is cut out of the triangles it overlaps, which are
+// retriangulated on their own. the simplicity tests go through a grid of
+// the edges, so they only look at edges near the new ones
+
+struct live_triangulation
+{
+    TPPLPartition partition;
+
+    // counter-clockwise triangles, whatever the winding of the polygon
+    std::vector<uint32_t> indices;
+
+    // the triangle left of each directed edge in indices
+    std::unordered_map<uint64_t, uint32_t> triangle_left_of;
+
+    edge_grid edges;
+
+    // twice the signed area of the polygon, positive if counter-clockwise
+    double area{};
+
+    // whether the edges so far, not counting the closing edge, don't touch
+    bool open_simple{ true };
+
+    // whether the polygon, closing edge included, is simple
+    bool simple{ true };
+
+    // whether indices is a triangulation of the polygon
+    bool valid{};
+
+    // scratch space for cut_out
+    std::vector<uint32_t> cavity;
+    std::vector<char> in_cavity;
+    std::unordered_map<uint32_t, uint32_t> boundary;
+    TPPLPoly cavity_poly;
+    std::vector<uint32_t> cavity_indices;
+
+    void clear()
+    {
+        indices.clear();
+        triangle_left_of.clear();
+        edges.clear();
+        area = 0;
+        open_simple = true;
+        simple = true;
+        valid = false;
+    }
+
+    //////////////////////////////////////////////////////////////////////
+
+    static uint64_t edge_key(uint32_t from, uint32_t to)
+    {
+        return ((uint64_t)from << 32) | to;
+    }
+
+    void add_triangle(uint32_t a, uint32_t b, uint32_t c)
+    {
+        uint32_t t = (uint32_t)(indices.size() / 3);
+        indices.insert(indices.end(), { a, b, c });
+        triangle_left_of[edge_key(a, b)] = t;
+        triangle_left_of[edge_key(b, c)] = t;
+        triangle_left_of[edge_key(c, a)] = t;
+    }
+
+    // the last triangle takes the place of the removed one
+
+    void remove_triangle(uint32_t t)
+    {
+        uint32_t *v = &indices[t * 3];
+        for(int i = 0; i < 3; ++i) {
+            triangle_left_of.erase(edge_key(v[i], v[(i + 1) % 3]));
+        }
+        uint32_t last = (uint32_t)(indices.size() / 3 - 1);
+        if(t != last) {
+            std::copy(&indices[last * 3], &indices[last * 3 + 3], v);
+            for(int i = 0; i < 3; ++i) {
+                triangle_left_of[edge_key(v[i], v[(i + 1) % 3])] = t;
+            }
+        }
+        indices.resize(last * 3);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    // call after appending a point
+
+    void append(std::vector<TPPLPoint> const &points)
+    {
+        size_t n = points.size();
+        if(n < 3) {
+            if(n == 2) {
+                edges.insert(points, 0);
+            }
+            indices.clear();
+            return;
+        }
+        uint32_t a = (uint32_t)(n - 2);
+        uint32_t b = (uint32_t)(n - 1);
+        double t = twice_area(points[a], points[b], points[0]);
+
+        // a-b stays, b-0 is replaced again by the next point
+        open_simple = open_simple && !edges.crosses(points, a, b, 0, n - 3);
+        simple = open_simple && !edges.crosses(points, b, 0, 1, n - 2);
+        edges.insert(points, a);
+
+        double old_area = area;
+        area += t;
+        if(!simple) {
+            // there is nothing to triangulate until it is simple again
+            indices.clear();
+            triangle_left_of.clear();
+            valid = false;
+        } else if(valid && t > 0 && old_area > 0) {
+            add_triangle(a, b, 0);
+        } else if(valid && t < 0 && old_area < 0) {
+            add_triangle(0, b, a);
+        } else if(!valid || area * old_area <= 0 || !cut_out(points, a, b, old_area > 0)) {
+            // when the winding flips, the old polygon is inside the triangle
+            retriangulate(points);
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    // cuts the triangle a, b, 0 out of the triangulation, after b moved the
+    // closing edge into the polygon. the triangles it overlaps are found by
+    // walking across edges from the old closing edge, and the region they
+    // cover, less the triangle, is retriangulated. returns false, with
+    // nothing changed, if that region isn't a simple polygon
+
+    bool cut_out(std::vector<TPPLPoint> const &points, uint32_t a, uint32_t b, bool ccw)
+    {
+        // the old closing edge and the triangle, counter-clockwise
+        uint32_t u = ccw ? a : 0;
+        uint32_t v = ccw ? 0 : a;
+        uint32_t const cut[3] = { v, b, u };
+
+        auto start = triangle_left_of.find(edge_key(u, v));
+        if(start == triangle_left_of.end()) {
+            return false;
+        }
+        if(in_cavity.size() < indices.size() / 3) {
+            in_cavity.resize(indices.size() / 3);
+        }
+        cavity.clear();
+        cavity.push_back(start->second);
+        in_cavity[start->second] = 1;
+        for(size_t i = 0; i < cavity.size(); ++i) {
+            uint32_t const *tri = &indices[cavity[i] * 3];
+            for(int j = 0; j < 3; ++j) {
+                auto across = triangle_left_of.find(edge_key(tri[(j + 1) % 3], tri[j]));
+                if(across != triangle_left_of.end() && !in_cavity[across->second] &&
+                   triangles_overlap(points, &indices[across->second * 3], cut)) {
+                    in_cavity[across->second] = 1;
+                    cavity.push_back(across->second);
+                }
+            }
+        }
+
+        // the outline of the region, with u-v swapped for u-b-v
+        bool pinched = false;
+        boundary.clear();
+        for(uint32_t c : cavity) {
+            uint32_t const *tri = &indices[c * 3];
+            for(int j = 0; j < 3; ++j) {
+                uint32_t from = tri[j];
+                uint32_t to = tri[(j + 1) % 3];
+                if(from == u && to == v) {
+                    pinched = pinched || !boundary.emplace(u, b).second;
+                    pinched = pinched || !boundary.emplace(b, v).second;
+                    continue;
+                }
+                auto across = triangle_left_of.find(edge_key(to, from));
+                if(across == triangle_left_of.end() || !in_cavity[across->second]) {
+                    pinched = pinched || !boundary.emplace(from, to).second;
+                }
+            }
+        }
+        for(uint32_t c : cavity) {
+            in_cavity[c] = 0;
+        }
+        if(pinched) {
+            return false;
+        }
+
+        // which has to be a single loop
+        long m = (long)boundary.size();
+        cavity_poly.Init(m);
+        uint32_t vertex = u;
+        for(long i = 0; i < m; ++i) {
+            if(i > 0 && vertex == u) {
+                return false;
+            }
+            cavity_poly[(int)i] = points[vertex];
+            cavity_poly[(int)i].id = (int)vertex;
+            auto next = boundary.find(vertex);
+            if(next == boundary.end()) {
+                return false;
+            }
+            vertex = next->second;
+        }
+        if(vertex != u) {
+            return false;
+        }
+
+        long num_triangles = 0;
+        cavity_indices.resize((m - 2) * 3);
+        if(partition.Triangulate_Auto(&cavity_poly, cavity_indices.data(), &num_triangles) == 0 || num_triangles != m - 2) {
+            return false;
+        }
+
+        std::sort(cavity.begin(), cavity.end(), std::greater<uint32_t>());
+        for(uint32_t c : cavity) {
+            remove_triangle(c);
+        }
+        for(long i = 0; i < num_triangles * 3; i += 3) {
+            add_triangle(cavity_poly[(int)cavity_indices[i]].id, cavity_poly[(int)cavity_indices[i + 1]].id,
+                         cavity_poly[(int)cavity_indices[i + 2]].id);
+        }
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    // triangulate from scratch, straight from the points. clockwise
+    // polygons are read back to front through a negative stride
+
+    long retriangulate(std::vector<TPPLPoint> const &points)
+    {
+        indices.clear();
+        triangle_left_of.clear();
+        area = 0;
+        valid = false;
+        size_t n = points.size();
+        if(n < 3) {
+            return 0;
+        }
+        for(size_t i = 1; i < n - 1; ++i) {
+            area += twice_area(points[0], points[i], points[i + 1]);
+        }
+        bool reversed = area < 0;
+        TPPLPointRange<TPPLPoint> range(points.data(), (long)n);
+        if(reversed) {
+            range = TPPLPointRange<TPPLPoint>(&points.back(), (long)n, -(long)sizeof(TPPLPoint));
+        }
+        long num_triangles = 0;
+        indices.resize((n - 2) * 3);
+        valid = partition.Triangulate_Auto(range, indices.data(), &num_triangles) != 0 && simple;
+        indices.resize(num_triangles * 3);
+        if(reversed) {
+            for(auto &i : indices) {
+                i = (uint32_t)(n - 1 - i);
+            }
+        }
+        if(valid) {
+            for(size_t i = 0; i < indices.size(); i += 3) {
+                for(int j = 0; j < 3; ++j) {
+                    triangle_left_of[edge_key(indices[i + j], indices[i + (j + 1) % 3])] = (uint32_t)(i / 3);
+                }
+            }
+        }
+        return num_triangles;
+    }
+};
+
 }    // namespace
 
 //////////////////////////////////////////////////////////////////////
@@ -250,7 +631,7 @@ struct gl_vertex_array
         glEnableVertexAttribArray(colorLocation);
 
         glBufferData(GL_ARRAY_BUFFER, sizeof(vert) * 8192, nullptr, GL_DYNAMIC_DRAW);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * 8192, nullptr, GL_DYNAMIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * 8192 * 3, nullptr, GL_DYNAMIC_DRAW);
 
         glVertexAttribPointer(positionLocation, 2, GL_FLOAT, GL_FALSE, sizeof(vert), (void *)(offsetof(vert, x)));
         glVertexAttribPointer(colorLocation, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(vert), (void *)(offsetof(vert, color)));
@@ -571,10 +952,9 @@ int main(int, char **)
     verts.init(program);
 
     std::vector<TPPLPoint> points;
-    TPPLPolyList triangles;
 
     std::vector<vert> triangle_vertices;
-    std::vector<GLushort> triangle_indices;
+    live_triangulation triangles;
 
     GLenum fill_mode = GL_FILL;
 
@@ -599,43 +979,14 @@ int main(int, char **)
 
         case 'C': {
             points.clear();
+            triangle_vertices.clear();
+            triangles.clear();
         } break;
 
         case 'T': {
-
-            if(is_clockwise(points)) {
-                log("Reversing points!");
-                std::reverse(points.begin(), points.end());
-                for(int i = 0; i < (int)points.size(); ++i) {
-                    points[i].id = i;
-                }
-            }
-            TPPLPoly poly;
-            poly.Init((long)points.size());
-            TPPLPoint *p = poly.GetPoints();
-            memcpy(p, points.data(), sizeof(TPPLPoint) * points.size());
-            TPPLPartition part;
-            triangles.clear();
-            part.Triangulate_MONO(&poly, &triangles);
-
-            triangle_vertices.clear();
-            triangle_vertices.reserve(points.size());
-            for(auto const &p : points) {
-                triangle_vertices.emplace_back((float)p.x, (float)p.y, 0xff0000ff);
-            }
-
-            log("{} triangles", triangles.size());
-            triangle_indices.clear();
-            triangle_indices.reserve(triangles.size() * 3);
-            for(auto const &t : triangles) {
-                if(t.GetNumPoints() != 3) {
-                    log("Huh?");
-                } else {
-                    for(int n = 0; n < 3; ++n) {
-                        triangle_indices.push_back(t.GetPoint(n).id);
-                    }
-                }
-            }
+            // the triangles are kept up to date anyway, this just starts over
+            long num_triangles = triangles.retriangulate(points);
+            log("{} triangles", num_triangles);
         } break;
         }
     };
@@ -643,6 +994,8 @@ int main(int, char **)
     window.on_left_click = [&](int x, int y) {
         int n = (int)points.size();
         points.emplace_back((float)x, (float)(window_height-y), n);
+        triangle_vertices.emplace_back((float)x, (float)(window_height-y), 0xff0000ff);
+        triangles.append(points);
     };
 
     window.on_draw = [&](int w, int h) {
@@ -661,15 +1014,15 @@ int main(int, char **)
 
         verts.activate(program);
 
-        if(!triangle_vertices.empty()) {
+        if(!triangles.indices.empty()) {
             vert *v = (vert *)glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-            GLushort *i = (GLushort *)glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_WRITE_ONLY);
+            GLuint *i = (GLuint *)glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_WRITE_ONLY);
             memcpy(v, triangle_vertices.data(), triangle_vertices.size() * sizeof(vert));
-            memcpy(i, triangle_indices.data(), triangle_indices.size() * sizeof(GLushort));
+            memcpy(i, triangles.indices.data(), triangles.indices.size() * sizeof(GLuint));
             glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
             glUnmapBuffer(GL_ARRAY_BUFFER);
             glPolygonMode(GL_FRONT_AND_BACK, fill_mode);
-            glDrawElements(GL_TRIANGLES, (GLsizei)triangle_indices.size(), GL_UNSIGNED_SHORT, (GLvoid *)0);
+            glDrawElements(GL_TRIANGLES, (GLsizei)triangles.indices.size(), GL_UNSIGNED_INT, (GLvoid *)0);
         }
 
         if(points.size() > 0) {
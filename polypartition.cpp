@@ -28,6 +28,16 @@
 #include <algorithm>
 #include <vector>
 
+#ifdef TPPL_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TPPL_TARGET_AVX
+#else
+#define TPPL_TARGET_AVX __attribute__((target("avx")))
+#endif
+#endif
+
 TPPLPoly::TPPLPoly() {
   hole = false;
   numpoints = 0;
@@ -35,11 +45,15 @@ TPPLPoly::TPPLPoly() {
 }
 
 TPPLPoly::~TPPLPoly() {
-  delete[] points;
+  if (points != inlinepoints) {
+    delete[] points;
+  }
 }
 
 void TPPLPoly::Clear() {
-  delete[] points;
+  if (points != inlinepoints) {
+    delete[] points;
+  }
   hole = false;
   numpoints = 0;
   points = NULL;
@@ -48,7 +62,11 @@ void TPPLPoly::Clear() {
 void TPPLPoly::Init(long numpoints) {
   Clear();
   this->numpoints = numpoints;
-  points = new TPPLPoint[numpoints];
+  if (numpoints <= NUMINLINEPOINTS) {
+    points = inlinepoints;
+  } else {
+    points = new TPPLPoint[numpoints];
+  }
 }
 
 void TPPLPoly::Triangle(TPPLPoint &p1, TPPLPoint &p2, TPPLPoint &p3) {
@@ -60,37 +78,60 @@ void TPPLPoly::Triangle(TPPLPoint &p1, TPPLPoint &p2, TPPLPoint &p3) {
 
 TPPLPoly::TPPLPoly(const TPPLPoly &src) :
         TPPLPoly() {
-  hole = src.hole;
-  numpoints = src.numpoints;
+  *this = src;
+}
 
-  if (numpoints > 0) {
-    points = new TPPLPoint[numpoints];
+TPPLPoly &TPPLPoly::operator=(const TPPLPoly &src) {
+  if (&src == this) {
+    return *this;
+  }
+  Clear();
+
+  if (src.numpoints > 0) {
+    Init(src.numpoints);
     memcpy(points, src.points, numpoints * sizeof(TPPLPoint));
   }
+  hole = src.hole;
+
+  return *this;
 }
 
-TPPLPoly &TPPLPoly::operator=(const TPPLPoly &src) {
+TPPLPoly::TPPLPoly(TPPLPoly &&src) noexcept :
+        TPPLPoly() {
+  *this = std::move(src);
+}
+
+TPPLPoly &TPPLPoly::operator=(TPPLPoly &&src) noexcept {
+  if (&src == this) {
+    return *this;
+  }
+  if (src.points == src.inlinepoints) {
+    // Inline points can't be taken over, only copied.
+    *this = src;
+    src.Clear();
+    return *this;
+  }
   Clear();
   hole = src.hole;
   numpoints = src.numpoints;
+  points = src.points;
 
-  if (numpoints > 0) {
-    points = new TPPLPoint[numpoints];
-    memcpy(points, src.points, numpoints * sizeof(TPPLPoint));
-  }
+  src.hole = false;
+  src.numpoints = 0;
+  src.points = NULL;
 
   return *this;
 }
 
 TPPLOrientation TPPLPoly::GetOrientation() const {
   long i1, i2;
-  tppl_float area = 0;
+  double area = 0;
   for (i1 = 0; i1 < numpoints; i1++) {
     i2 = i1 + 1;
     if (i2 == numpoints) {
       i2 = 0;
     }
-    area += points[i1].x * points[i2].y - points[i1].y * points[i2].x;
+    area += (double)points[i1].x * points[i2].y - (double)points[i1].y * points[i2].x;
   }
   if (area > 0) {
     return TPPL_ORIENTATION_CCW;
@@ -112,26 +153,567 @@ void TPPLPoly::Invert() {
   std::reverse(points, points + numpoints);
 }
 
+TPPLVisibility::TPPLVisibility() {
+  numpoints = 0;
+  rowstarts = NULL;
+  bits = NULL;
+  numwords = 0;
+  rowcapacity = 0;
+  wordcapacity = 0;
+}
+
+TPPLVisibility::~TPPLVisibility() {
+  delete[] rowstarts;
+  delete[] bits;
+}
+
+TPPLVisibility::TPPLVisibility(const TPPLVisibility &src) :
+        TPPLVisibility() {
+  *this = src;
+}
+
+TPPLVisibility &TPPLVisibility::operator=(const TPPLVisibility &src) {
+  if (&src == this) {
+    return *this;
+  }
+  Init(src.numpoints);
+  if (numpoints > 0) {
+    memcpy(bits, src.bits, numwords * sizeof(uint32_t));
+  }
+  return *this;
+}
+
+void TPPLVisibility::Clear() {
+  delete[] rowstarts;
+  delete[] bits;
+  numpoints = 0;
+  rowstarts = NULL;
+  bits = NULL;
+  numwords = 0;
+  rowcapacity = 0;
+  wordcapacity = 0;
+}
+
+void TPPLVisibility::Init(long numpoints) {
+  long i;
+
+  this->numpoints = 0;
+  numwords = 0;
+  if (numpoints <= 0) {
+    return;
+  }
+  this->numpoints = numpoints;
+  if (numpoints > rowcapacity) {
+    delete[] rowstarts;
+    rowstarts = new long[numpoints];
+    rowcapacity = numpoints;
+  }
+  // Row i holds the bits of j = i + 1 to numpoints - 1.
+  for (i = 0; i < numpoints; i++) {
+    rowstarts[i] = 32 * numwords - i - 1;
+    numwords += (numpoints - i - 1 + 31) / 32;
+  }
+  if ((numwords > wordcapacity) || !bits) {
+    delete[] bits;
+    bits = new uint32_t[numwords > 0 ? numwords : 1];
+    wordcapacity = numwords;
+  }
+  memset(bits, 0, numwords * sizeof(uint32_t));
+}
+
 TPPLPartition::PartitionVertex::PartitionVertex() :
         previous(NULL), next(NULL) {
 }
 
-TPPLPoint TPPLPartition::Normalize(const TPPLPoint &p) {
-  TPPLPoint r;
-  tppl_float n = sqrt(p.x * p.x + p.y * p.y);
+TPPLPartition::NodePool::NodePool() :
+        numsizeclasses(0), chunks(NULL), chunkpos(NULL), chunkend(NULL), numallocations(0) {
+}
+
+TPPLPartition::NodePool::~NodePool() {
+  char *chunk;
+  while (chunks) {
+    chunk = chunks;
+    chunks = *((char **)chunk);
+    delete[] chunk;
+  }
+}
+
+void *TPPLPartition::NodePool::Allocate(size_t size) {
+  const size_t alignment = 16;
+  const size_t chunksize = 16384;
+  FreeBlock *block;
+  char *chunk;
+  long i;
+
+  size = (size + alignment - 1) & ~(alignment - 1);
+
+  for (i = 0; i < numsizeclasses; i++) {
+    if (sizeclasses[i].size == size) {
+      break;
+    }
+  }
+  if (i == numsizeclasses) {
+    if (numsizeclasses == (long)(sizeof(sizeclasses) / sizeof(sizeclasses[0]))) {
+      // Out of size classes, this size is served by the global heap.
+      numallocations++;
+      return ::operator new(size);
+    }
+    sizeclasses[i].size = size;
+    sizeclasses[i].freelist = NULL;
+    numsizeclasses++;
+  }
+
+  block = sizeclasses[i].freelist;
+  if (block) {
+    sizeclasses[i].freelist = block->next;
+    return block;
+  }
+
+  if (chunkpos + size > chunkend) {
+    // The first alignment bytes of each chunk link it to the previous one.
+    chunk = new char[alignment + (size > chunksize ? size : chunksize)];
+    *((char **)chunk) = chunks;
+    chunks = chunk;
+    chunkpos = chunk + alignment;
+    chunkend = chunkpos + (size > chunksize ? size : chunksize);
+    numallocations++;
+  }
+  block = (FreeBlock *)chunkpos;
+  chunkpos += size;
+  return block;
+}
+
+void TPPLPartition::NodePool::Deallocate(void *p, size_t size) {
+  const size_t alignment = 16;
+  FreeBlock *block;
+  long i;
+
+  size = (size + alignment - 1) & ~(alignment - 1);
+
+  for (i = 0; i < numsizeclasses; i++) {
+    if (sizeclasses[i].size == size) {
+      block = (FreeBlock *)p;
+      block->next = sizeclasses[i].freelist;
+      sizeclasses[i].freelist = block;
+      return;
+    }
+  }
+  ::operator delete(p);
+}
+
+#ifdef TPPL_SCANLINE_SKIPLIST
+TPPLPartition::ScanLineSkipList::ScanLineSkipList(char *memory, long capacity) :
+        memory(memory), capacity(capacity), numnodes(0), numlevels(1), random(0x9E3779B9) {
+  long i;
+
+  head = (Node *)memory;
+  memoryused = (long)(sizeof(Node) + (MAXLEVELS - 1) * sizeof(Node *));
+  head->previous = head;
+  head->numlevels = MAXLEVELS;
+  for (i = 0; i < MAXLEVELS; i++) {
+    head->next[i] = NULL;
+  }
+}
+
+TPPLPartition::ScanLineSkipList::iterator TPPLPartition::ScanLineSkipList::begin() {
+  if (head->next[0] == NULL) {
+    return iterator(head);
+  }
+  return iterator(head->next[0]);
+}
+
+TPPLPartition::ScanLineSkipList::iterator TPPLPartition::ScanLineSkipList::end() {
+  return iterator(head);
+}
+
+TPPLPartition::ScanLineSkipList::Node *TPPLPartition::ScanLineSkipList::Find(const ScanLineEdge &edge, Node **update) {
+  Node *node = head;
+  Node *bound = NULL;
+  long level;
+
+  for (level = numlevels - 1; level >= 0; level--) {
+    // bound is known not to be before edge, don't compare it again.
+    while ((node->next[level] != bound) && (node->next[level]->edge < edge)) {
+      node = node->next[level];
+    }
+    bound = node->next[level];
+    if (update != NULL) {
+      update[level] = node;
+    }
+  }
+  return node->next[0];
+}
+
+TPPLPartition::ScanLineSkipList::iterator TPPLPartition::ScanLineSkipList::lower_bound(const ScanLineEdge &edge) {
+  Node *node = Find(edge, NULL);
+  if (node == NULL) {
+    return end();
+  }
+  return iterator(node);
+}
+
+std::pair<TPPLPartition::ScanLineSkipList::iterator, bool> TPPLPartition::ScanLineSkipList::insert(const ScanLineEdge &edge) {
+  Node *update[MAXLEVELS];
+  Node *node;
+  long level, maxlevel, i;
+  uint32_t bits;
+
+  node = Find(edge, update);
+  if ((node != NULL) && !(edge < node->edge)) {
+    // Same as std::set, an equivalent edge is kept.
+    return std::make_pair(iterator(node), false);
+  }
+
+  // Each level is kept with probability 1/4.
+  random ^= random << 13;
+  random ^= random >> 17;
+  random ^= random << 5;
+  bits = random;
+  level = 1;
+  while (((bits & 3) == 0) && (level < MAXLEVELS)) {
+    bits >>= 2;
+    level++;
+  }
+  // Leave room for a single link node for each node still to come.
+  maxlevel = (MemorySize(capacity) - memoryused - (capacity - numnodes) * (long)sizeof(Node)) / (long)sizeof(Node *) + 1;
+  if (level > maxlevel) {
+    level = maxlevel;
+  }
+  for (i = numlevels; i < level; i++) {
+    update[i] = head;
+  }
+  if (level > numlevels) {
+    numlevels = level;
+  }
+
+  node = (Node *)(memory + memoryused);
+  memoryused += (long)(sizeof(Node) + (level - 1) * sizeof(Node *));
+  numnodes++;
+  node->edge = edge;
+  node->numlevels = level;
+  for (i = 0; i < level; i++) {
+    node->next[i] = update[i]->next[i];
+    update[i]->next[i] = node;
+  }
+  node->previous = update[0];
+  if (node->next[0] == NULL) {
+    head->previous = node;
+  } else {
+    node->next[0]->previous = node;
+  }
+  return std::make_pair(iterator(node), true);
+}
+
+void TPPLPartition::ScanLineSkipList::erase(iterator position) {
+  Node *node = position.node;
+  Node *predecessor = node->previous;
+  long level;
+
+  // The predecessor on each level is the closest earlier node that high,
+  // so no edges have to be compared.
+  for (level = 0; level < node->numlevels; level++) {
+    while ((predecessor != head) && (predecessor->numlevels <= level)) {
+      predecessor = predecessor->previous;
+    }
+    predecessor->next[level] = node->next[level];
+  }
+  if (node->next[0] == NULL) {
+    head->previous = node->previous;
+  } else {
+    node->next[0]->previous = node->previous;
+  }
+}
+#endif
+
+long TPPLPartition::GetAllocationCount() const {
+  return workspace.numallocations + workspace.nodepool.numallocations;
+}
+
+void TPPLPartition::SetNumThreads(long numthreads) {
+  threadpool.SetNumThreads(numthreads);
+}
+
+long TPPLPartition::GetNumThreads() const {
+  return threadpool.GetNumThreads();
+}
+
+int TPPLPartition::RunBatch(BatchAlgorithm algorithm, TPPLPolyList *groups, long numgroups, TPPLPolyList *results, int *statuses) {
+  long i, numthreads;
+
+  struct Batch {
+    BatchAlgorithm algorithm;
+    TPPLPartition *partitions;
+    TPPLPolyList *groups;
+    TPPLPolyList *results;
+    int *statuses;
+
+    void operator()(long begin, long end, long thread) {
+      TPPLPartition *instance;
+      long i;
+
+      instance = &partitions[thread];
+      for (i = begin; i < end; i++) {
+        switch (algorithm) {
+          case BATCH_TRIANGULATE_EC:
+            statuses[i] = instance->Triangulate_EC(&groups[i], &results[i]);
+            break;
+          case BATCH_TRIANGULATE_MONO:
+            statuses[i] = instance->Triangulate_MONO(&groups[i], &results[i]);
+            break;
+          case BATCH_CONVEX_PARTITION_HM:
+            statuses[i] = instance->ConvexPartition_HM(&groups[i], &results[i]);
+            break;
+        }
+      }
+    }
+  } batch;
+
+  numthreads = threadpool.GetNumThreads();
+  if (!statuses) {
+    statuses = workspace.Get(workspace.batchstatuses, numgroups);
+  }
+  // A group that is never run counts as failed.
+  for (i = 0; i < numgroups; i++) {
+    statuses[i] = 0;
+  }
+
+  batch.algorithm = algorithm;
+  batch.partitions = workspace.Get(workspace.batchpartitions, numthreads);
+  batch.groups = groups;
+  batch.results = results;
+  batch.statuses = statuses;
+
+  // Groups are usually small, so hand them out a few at a time.
+  threadpool.Run(numgroups, 16, batch);
+
+  for (i = 0; i < numgroups; i++) {
+    if (!statuses[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+thread_local TPPLPartition::ThreadPool *TPPLPartition::ThreadPool::currentpool = NULL;
+thread_local long TPPLPartition::ThreadPool::currentthread = 0;
+
+TPPLPartition::ThreadPool::ThreadPool() :
+        numthreads(1), workers(NULL), shares(NULL), generation(0), numbusy(0), stopping(false),
+        function(NULL), task(NULL), count(0), chunksize(0) {
+  shares = new Share[1];
+}
+
+TPPLPartition::ThreadPool::~ThreadPool() {
+  Stop();
+  delete[] shares;
+}
+
+TPPLPartition::ThreadPool::ThreadPool(const ThreadPool &src) :
+        ThreadPool() {
+  SetNumThreads(src.numthreads);
+}
+
+TPPLPartition::ThreadPool &TPPLPartition::ThreadPool::operator=(const ThreadPool &src) {
+  SetNumThreads(src.numthreads);
+  return *this;
+}
+
+void TPPLPartition::ThreadPool::SetNumThreads(long numthreads) {
+  if (numthreads <= 0) {
+    numthreads = (long)std::thread::hardware_concurrency();
+    if (numthreads <= 0) {
+      numthreads = 1;
+    }
+  }
+  if (numthreads == this->numthreads) {
+    return;
+  }
+  Stop();
+  delete[] shares;
+  this->numthreads = numthreads;
+  shares = new Share[numthreads];
+}
+
+void TPPLPartition::ThreadPool::Start() {
+  long i;
+
+  workers = new std::thread[numthreads - 1];
+  for (i = 1; i < numthreads; i++) {
+    workers[i - 1] = std::thread(&ThreadPool::WorkerLoop, this, i, generation);
+  }
+}
+
+void TPPLPartition::ThreadPool::Stop() {
+  long i;
+
+  if (!workers) {
+    return;
+  }
+  mutex.lock();
+  stopping = true;
+  mutex.unlock();
+  wakeup.notify_all();
+  for (i = 1; i < numthreads; i++) {
+    workers[i - 1].join();
+  }
+  delete[] workers;
+  workers = NULL;
+  stopping = false;
+}
+
+// Takes a chunk from the front of thread's share, or from its back when
+// stealing. Returns false if the share is empty.
+bool TPPLPartition::ThreadPool::Take(long thread, bool steal, long *chunk) {
+  uint64_t chunks, newchunks;
+  uint64_t first, end;
+
+  chunks = shares[thread].chunks.load(std::memory_order_relaxed);
+  for (;;) {
+    first = chunks >> 32;
+    end = chunks & 0xFFFFFFFF;
+    if (first >= end) {
+      return false;
+    }
+    if (steal) {
+      newchunks = (first << 32) | (end - 1);
+    } else {
+      newchunks = ((first + 1) << 32) | end;
+    }
+    if (shares[thread].chunks.compare_exchange_weak(chunks, newchunks, std::memory_order_relaxed)) {
+      *chunk = (long)(steal ? (end - 1) : first);
+      return true;
+    }
+  }
+}
+
+void TPPLPartition::ThreadPool::Work(long thread) {
+  long chunk, begin, end, i;
+
+  for (;;) {
+    if (!Take(thread, false, &chunk)) {
+      for (i = 1; i < numthreads; i++) {
+        if (Take((thread + i) % numthreads, true, &chunk)) {
+          break;
+        }
+      }
+      if (i == numthreads) {
+        return;
+      }
+    }
+    begin = chunk * chunksize;
+    end = std::min(begin + chunksize, count);
+    function(task, begin, end, thread);
+  }
+}
+
+void TPPLPartition::ThreadPool::WorkerLoop(long thread, long generation) {
+  currentpool = this;
+  currentthread = thread;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (!stopping && (this->generation == generation)) {
+        wakeup.wait(lock);
+      }
+      if (stopping) {
+        return;
+      }
+      generation = this->generation;
+    }
+
+    Work(thread);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      numbusy--;
+      if (numbusy == 0) {
+        finished.notify_one();
+      }
+    }
+  }
+}
+
+void TPPLPartition::ThreadPool::Run(long count, long chunksize, void (*function)(void *, long, long, long), void *task) {
+  ThreadPool *previouspool;
+  long numchunks, i, previousthread;
+
+  if (count <= 0) {
+    return;
+  }
+  // Called from a task of this pool, which is still using shares and the
+  // task fields, so stay on the calling thread.
+  if (currentpool == this) {
+    function(task, 0, count, currentthread);
+    return;
+  }
+  numchunks = (count + chunksize - 1) / chunksize;
+  if ((numthreads <= 1) || (numchunks <= 1)) {
+    function(task, 0, count, 0);
+    return;
+  }
+  if (!workers) {
+    Start();
+  }
+
+  for (i = 0; i < numthreads; i++) {
+    shares[i].chunks.store(((uint64_t)(numchunks * i / numthreads) << 32) |
+                    (uint64_t)(numchunks * (i + 1) / numthreads),
+            std::memory_order_relaxed);
+  }
+  this->function = function;
+  this->task = task;
+  this->count = count;
+  this->chunksize = chunksize;
+
+  mutex.lock();
+  generation++;
+  numbusy = numthreads - 1;
+  mutex.unlock();
+  wakeup.notify_all();
+
+  previouspool = currentpool;
+  previousthread = currentthread;
+  currentpool = this;
+  currentthread = 0;
+  Work(0);
+  currentpool = previouspool;
+  currentthread = previousthread;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (numbusy > 0) {
+    finished.wait(lock);
+  }
+}
+
+tppl_float TPPLPartition::Cosine(const TPPLPoint &p, const TPPLPoint &p1, const TPPLPoint &p2) {
+  tppl_float x1, y1, x2, y2, n;
+  x1 = (tppl_float)p1.x - p.x;
+  y1 = (tppl_float)p1.y - p.y;
+  n = sqrt(x1 * x1 + y1 * y1);
+  if (n != 0) {
+    x1 = x1 / n;
+    y1 = y1 / n;
+  } else {
+    x1 = 0;
+    y1 = 0;
+  }
+  x2 = (tppl_float)p2.x - p.x;
+  y2 = (tppl_float)p2.y - p.y;
+  n = sqrt(x2 * x2 + y2 * y2);
   if (n != 0) {
-    r = p / n;
+    x2 = x2 / n;
+    y2 = y2 / n;
   } else {
-    r.x = 0;
-    r.y = 0;
+    x2 = 0;
+    y2 = 0;
   }
-  return r;
+  return x1 * x2 + y1 * y2;
 }
 
 tppl_float TPPLPartition::Distance(const TPPLPoint &p1, const TPPLPoint &p2) {
   tppl_float dx, dy;
-  dx = p2.x - p1.x;
-  dy = p2.y - p1.y;
+  dx = (tppl_float)p2.x - p1.x;
+  dy = (tppl_float)p2.y - p1.y;
   return (sqrt(dx * dx + dy * dy));
 }
 
@@ -150,29 +732,12 @@ int TPPLPartition::Intersects(TPPLPoint &p11, TPPLPoint &p12, TPPLPoint &p21, TP
     return 0;
   }
 
-  TPPLPoint v1ort, v2ort, v;
-  tppl_float dot11, dot12, dot21, dot22;
-
-  v1ort.x = p12.y - p11.y;
-  v1ort.y = p11.x - p12.x;
-
-  v2ort.x = p22.y - p21.y;
-  v2ort.y = p21.x - p22.x;
-
-  v = p21 - p11;
-  dot21 = v.x * v1ort.x + v.y * v1ort.y;
-  v = p22 - p11;
-  dot22 = v.x * v1ort.x + v.y * v1ort.y;
-
-  v = p11 - p21;
-  dot11 = v.x * v2ort.x + v.y * v2ort.y;
-  v = p12 - p21;
-  dot12 = v.x * v2ort.x + v.y * v2ort.y;
-
-  if (dot11 * dot12 > 0) {
+  // The lines intersect unless the endpoints of one lie strictly on the
+  // same side of the other.
+  if (Orientation(p21, p22, p11) * Orientation(p21, p22, p12) > 0) {
     return 0;
   }
-  if (dot21 * dot22 > 0) {
+  if (Orientation(p11, p12, p21) * Orientation(p11, p12, p22) > 0) {
     return 0;
   }
 
@@ -305,60 +870,617 @@ int TPPLPartition::RemoveHoles(TPPLPolyList *inpolys, TPPLPolyList *outpolys) {
 
     polys.erase(holeiter);
     polys.erase(polyiter);
-    polys.push_back(newpoly);
+    polys.push_back(std::move(newpoly));
   }
 
-  for (iter = polys.begin(); iter != polys.end(); iter++) {
-    outpolys->push_back(*iter);
-  }
+  outpolys->splice(outpolys->end(), polys);
 
   return 1;
 }
 
-bool TPPLPartition::IsConvex(TPPLPoint &p1, TPPLPoint &p2, TPPLPoint &p3) {
-  tppl_float tmp;
-  tmp = (p3.y - p1.y) * (p2.x - p1.x) - (p3.x - p1.x) * (p2.y - p1.y);
-  if (tmp > 0) {
-    return 1;
-  } else {
-    return 0;
+void TPPLPartition::GetGridCell(HoleGrid *grid, const TPPLPoint &p, long *column, long *row) {
+  *column = (long)(((tppl_float)p.x - grid->minx) * grid->scalex);
+  *row = (long)(((tppl_float)p.y - grid->miny) * grid->scaley);
+  if (*column < 0) {
+    *column = 0;
+  } else if (*column >= grid->numcolumns) {
+    *column = grid->numcolumns - 1;
+  }
+  if (*row < 0) {
+    *row = 0;
+  } else if (*row >= grid->numrows) {
+    *row = grid->numrows - 1;
   }
 }
 
-bool TPPLPartition::IsReflex(TPPLPoint &p1, TPPLPoint &p2, TPPLPoint &p3) {
-  tppl_float tmp;
-  tmp = (p3.y - p1.y) * (p2.x - p1.x) - (p3.x - p1.x) * (p2.y - p1.y);
-  if (tmp < 0) {
-    return 1;
+// Starts walking the segment from p1 to p2 through the grid, a row at
+// a time from its lower end, see WalkGridSegment.
+void TPPLPartition::StartGridWalk(HoleGrid *grid, const TPPLPoint &p1, const TPPLPoint &p2, GridWalk *walk) {
+  long column;
+
+  if (p1.y <= p2.y) {
+    walk->x1 = p1.x;
+    walk->y1 = p1.y;
+    walk->x2 = p2.x;
+    walk->y2 = p2.y;
   } else {
-    return 0;
+    walk->x1 = p2.x;
+    walk->y1 = p2.y;
+    walk->x2 = p1.x;
+    walk->y2 = p1.y;
   }
+  GetGridCell(grid, (p1.y <= p2.y) ? p1 : p2, &column, &walk->firstrow);
+  GetGridCell(grid, (p1.y <= p2.y) ? p2 : p1, &column, &walk->lastrow);
+  // Only used between rows, so the segment isn't horizontal.
+  walk->dxdy = (walk->firstrow == walk->lastrow) ? 0 : (walk->x2 - walk->x1) / (walk->y2 - walk->y1);
+  walk->row = walk->firstrow;
 }
 
-bool TPPLPartition::IsInside(TPPLPoint &p1, TPPLPoint &p2, TPPLPoint &p3, TPPLPoint &p) {
-  if (IsConvex(p1, p, p2)) {
+// Steps the walk to its next row, setting first and last to the columns
+// the segment crosses in that row, widened by a column on either side so
+// that rounding can't lose a cell. Returns false past the upper end.
+bool TPPLPartition::WalkGridSegment(HoleGrid *grid, GridWalk *walk, long *row, long *first, long *last) {
+  tppl_float x1, x2;
+  long column1, column2;
+
+  if (walk->row > walk->lastrow) {
     return false;
   }
-  if (IsConvex(p2, p, p3)) {
-    return false;
+  *row = walk->row;
+  if (walk->row == walk->lastrow) {
+    x2 = walk->x2;
+  } else {
+    x2 = walk->x1 + (grid->miny + (walk->row + 1) / grid->scaley - walk->y1) * walk->dxdy;
   }
-  if (IsConvex(p3, p, p1)) {
-    return false;
+  if (walk->row == walk->firstrow) {
+    x1 = walk->x1;
+  } else {
+    x1 = walk->x1 + (grid->miny + walk->row / grid->scaley - walk->y1) * walk->dxdy;
   }
+  column1 = (long)((std::min(x1, x2) - grid->minx) * grid->scalex) - 1;
+  column2 = (long)((std::max(x1, x2) - grid->minx) * grid->scalex) + 1;
+  *first = std::max(column1, 0L);
+  *last = std::min(column2, grid->numcolumns - 1);
+  walk->row++;
   return true;
 }
 
-bool TPPLPartition::InCone(TPPLPoint &p1, TPPLPoint &p2, TPPLPoint &p3, TPPLPoint &p) {
-  bool convex;
+// Adds the edge from vertex to the next vertex to the cells it crosses.
+void TPPLPartition::InsertGridEdge(HoleGrid *grid, long vertex) {
+  long column, row, first, last, cell;
+  GridWalk walk;
+
+  StartGridWalk(grid, grid->points[vertex], grid->points[grid->next[vertex]], &walk);
+  while (WalkGridSegment(grid, &walk, &row, &first, &last)) {
+    for (column = first; column <= last; column++) {
+      cell = row * grid->numcolumns + column;
+      grid->entries = workspace.Grow(workspace.gridentries, grid->numentries + 1, grid->numentries);
+      grid->entries[grid->numentries].vertex = vertex;
+      grid->entries[grid->numentries].next = grid->cells[cell];
+      grid->cells[cell] = grid->numentries;
+      grid->numentries++;
+    }
+  }
+}
 
-  convex = IsConvex(p1, p2, p3);
+bool TPPLPartition::IsBridgeVisible(HoleGrid *grid, TPPLPoint &holepoint, long vertex) {
+  long column, row, first, last, entry, edge;
+  TPPLPoint polypoint;
+  GridWalk walk;
 
-  if (convex) {
-    if (!IsConvex(p1, p2, p)) {
-      return false;
+  polypoint = grid->points[vertex];
+  StartGridWalk(grid, holepoint, polypoint, &walk);
+
+  grid->mark++;
+  while (WalkGridSegment(grid, &walk, &row, &first, &last)) {
+    for (column = first; column <= last; column++) {
+      for (entry = grid->cells[row * grid->numcolumns + column]; entry >= 0; entry = grid->entries[entry].next) {
+        edge = grid->entries[entry].vertex;
+        if (grid->marks[edge] == grid->mark) {
+          continue;
+        }
+        grid->marks[edge] = grid->mark;
+        if (Intersects(holepoint, polypoint, grid->points[edge], grid->points[grid->next[edge]])) {
+          return false;
+        }
+      }
     }
-    if (!IsConvex(p2, p3, p)) {
-      return false;
+  }
+  return true;
+}
+
+long TPPLPartition::FindHoleBridge(HoleGrid *grid, TPPLPoint &holepoint) {
+  long column1, row1, column2, row2, column, row, entry, vertex, bestvertex;
+  tppl_float x, hitx, tangent, besttangent;
+  TPPLPoint p1, p2, hitpoint, bestpoint;
+  int orientation1, orientation2, orientation3;
+  bool found;
+
+  // Cast the ray through the cells right of holepoint until no cell can
+  // have a nearer hit. Only edges going up can be hit from inside a
+  // counter-clockwise ring.
+  GetGridCell(grid, holepoint, &column1, &row);
+  found = false;
+  bestvertex = -1;
+  hitx = 0;
+  grid->mark++;
+  for (column = column1; column < grid->numcolumns; column++) {
+    if (found && (hitx - grid->minx) * grid->scalex < column) {
+      break;
+    }
+    for (entry = grid->cells[row * grid->numcolumns + column]; entry >= 0; entry = grid->entries[entry].next) {
+      vertex = grid->entries[entry].vertex;
+      if (grid->marks[vertex] == grid->mark) {
+        continue;
+      }
+      grid->marks[vertex] = grid->mark;
+      p1 = grid->points[vertex];
+      p2 = grid->points[grid->next[vertex]];
+      if ((p1.y > holepoint.y) || (p2.y < holepoint.y) || (p1.y == p2.y)) {
+        continue;
+      }
+      x = (tppl_float)p1.x + ((tppl_float)holepoint.y - p1.y) * ((tppl_float)p2.x - p1.x) / ((tppl_float)p2.y - p1.y);
+      if ((x < holepoint.x) || (found && (x >= hitx))) {
+        continue;
+      }
+      found = true;
+      hitx = x;
+      bestvertex = (p1.x > p2.x) ? vertex : grid->next[vertex];
+    }
+  }
+  if (!found) {
+    return -1;
+  }
+
+  // The right end of the hit edge is a candidate, but ring vertices in the
+  // triangle between holepoint, the hit and that end can block it. Of
+  // those (and the end itself), take the one closest in angle to the ray
+  // that has holepoint in its cone.
+  bestpoint = grid->points[bestvertex];
+  hitpoint.x = (tppl_coord)hitx;
+  if (hitpoint.x < hitx) {
+    hitpoint.x += 1;
+  }
+  hitpoint.y = holepoint.y;
+
+  GetGridCell(grid, holepoint, &column1, &row1);
+  GetGridCell(grid, bestpoint, &column2, &row2);
+  if (row1 > row2) {
+    std::swap(row1, row2);
+  }
+  bestvertex = -1;
+  besttangent = 0;
+  grid->mark++;
+  for (row = row1; row <= row2; row++) {
+    for (column = column1; column <= column2; column++) {
+      for (entry = grid->cells[row * grid->numcolumns + column]; entry >= 0; entry = grid->entries[entry].next) {
+        vertex = grid->entries[entry].vertex;
+        if (grid->marks[vertex] == grid->mark) {
+          continue;
+        }
+        grid->marks[vertex] = grid->mark;
+        p1 = grid->points[vertex];
+        if ((p1.x <= holepoint.x) || (p1.x > bestpoint.x)) {
+          continue;
+        }
+        orientation1 = Orientation(holepoint, hitpoint, p1);
+        orientation2 = Orientation(hitpoint, bestpoint, p1);
+        orientation3 = Orientation(bestpoint, holepoint, p1);
+        if (((orientation1 < 0) || (orientation2 < 0) || (orientation3 < 0)) &&
+                ((orientation1 > 0) || (orientation2 > 0) || (orientation3 > 0))) {
+          continue;
+        }
+        tangent = fabs((tppl_float)p1.y - holepoint.y) / ((tppl_float)p1.x - holepoint.x);
+        if ((bestvertex >= 0) && ((tangent > besttangent) ||
+                                          ((tangent == besttangent) && (p1.x >= grid->points[bestvertex].x)))) {
+          continue;
+        }
+        if (!InCone(grid->points[grid->previous[vertex]], p1, grid->points[grid->next[vertex]], holepoint)) {
+          continue;
+        }
+        bestvertex = vertex;
+        besttangent = tangent;
+      }
+    }
+  }
+
+  if ((bestvertex < 0) || !IsBridgeVisible(grid, holepoint, bestvertex)) {
+    return -1;
+  }
+  return bestvertex;
+}
+
+long TPPLPartition::FindHoleBridgeSlow(HoleGrid *grid, TPPLPoint &holepoint, long numvertices) {
+  long vertex, bestvertex;
+  tppl_float distance, bestdistance;
+  TPPLPoint polypoint;
+
+  bestvertex = -1;
+  bestdistance = 0;
+  for (vertex = 0; vertex < numvertices; vertex++) {
+    // Vertices of holes that aren't bridged yet aren't linked.
+    if (grid->previous[vertex] < 0) {
+      continue;
+    }
+    polypoint = grid->points[vertex];
+    if (polypoint.x <= holepoint.x) {
+      continue;
+    }
+    if (!InCone(grid->points[grid->previous[vertex]], polypoint, grid->points[grid->next[vertex]], holepoint)) {
+      continue;
+    }
+    distance = Distance(holepoint, polypoint);
+    if ((bestvertex >= 0) && (bestdistance < distance)) {
+      continue;
+    }
+    if (IsBridgeVisible(grid, holepoint, vertex)) {
+      bestvertex = vertex;
+      bestdistance = distance;
+    }
+  }
+  return bestvertex;
+}
+
+int TPPLPartition::RemoveHoles_Grid(TPPLPolyList *inpolys, TPPLPolyList *outpolys) {
+  TPPLPolyList::iterator iter;
+  HoleEntry *holes;
+  HoleGrid grid;
+  long *polystarts;
+  long i, j, numpolys, numholes, numvertices, maxvertices, numcells;
+  long start, count, vertex, vertexcopy, holecopy, last;
+  tppl_float maxx, maxy;
+  TPPLPoint holepoint;
+  TPPLPoly newpoly;
+
+  numpolys = 0;
+  numholes = 0;
+  numvertices = 0;
+  for (iter = inpolys->begin(); iter != inpolys->end(); iter++) {
+    numpolys++;
+    numvertices += iter->GetNumPoints();
+    if (iter->IsHole()) {
+      numholes++;
+    }
+  }
+
+  // Check for the trivial case of no holes.
+  if (numholes == 0) {
+    for (iter = inpolys->begin(); iter != inpolys->end(); iter++) {
+      outpolys->push_back(*iter);
+    }
+    return 1;
+  }
+
+  // Every bridge adds a copy of both of its ends.
+  maxvertices = numvertices + 2 * numholes;
+  holes = workspace.Get(workspace.holes, numholes);
+  polystarts = workspace.Get(workspace.polystarts, numpolys + 1);
+  grid.points = workspace.Get(workspace.ringpoints, maxvertices);
+  grid.previous = workspace.Get(workspace.ringprevious, maxvertices);
+  grid.next = workspace.Get(workspace.ringnext, maxvertices);
+  grid.marks = workspace.Get(workspace.gridmarks, maxvertices);
+  grid.mark = 0;
+
+  // Link the rings of the non-hole polygons. Hole vertices stay unlinked
+  // until their hole is bridged.
+  i = 0;
+  numvertices = 0;
+  numholes = 0;
+  for (iter = inpolys->begin(); iter != inpolys->end(); iter++, i++) {
+    polystarts[i] = numvertices;
+    count = iter->GetNumPoints();
+    for (j = 0; j < count; j++) {
+      grid.points[numvertices + j] = iter->GetPoint(j);
+      grid.marks[numvertices + j] = 0;
+      if (iter->IsHole()) {
+        grid.previous[numvertices + j] = -1;
+        grid.next[numvertices + j] = -1;
+      } else {
+        grid.previous[numvertices + j] = numvertices + (j + count - 1) % count;
+        grid.next[numvertices + j] = numvertices + (j + 1) % count;
+      }
+    }
+    if (iter->IsHole() && (count > 0)) {
+      holes[numholes].poly = i;
+      holes[numholes].vertex = numvertices;
+      for (j = 1; j < count; j++) {
+        if (grid.points[numvertices + j].x > grid.points[holes[numholes].vertex].x) {
+          holes[numholes].vertex = numvertices + j;
+        }
+      }
+      holes[numholes].maxx = grid.points[holes[numholes].vertex].x;
+      numholes++;
+    }
+    numvertices += count;
+  }
+  polystarts[numpolys] = numvertices;
+  for (j = numvertices; j < maxvertices; j++) {
+    grid.marks[j] = 0;
+  }
+
+  std::sort(holes, holes + numholes);
+
+  // Set up a grid of about one cell per vertex over the bounding box of
+  // all vertices.
+  grid.minx = grid.points[0].x;
+  grid.miny = grid.points[0].y;
+  maxx = grid.minx;
+  maxy = grid.miny;
+  for (j = 1; j < numvertices; j++) {
+    grid.minx = std::min(grid.minx, (tppl_float)grid.points[j].x);
+    grid.miny = std::min(grid.miny, (tppl_float)grid.points[j].y);
+    maxx = std::max(maxx, (tppl_float)grid.points[j].x);
+    maxy = std::max(maxy, (tppl_float)grid.points[j].y);
+  }
+  grid.numcolumns = (long)sqrt((double)numvertices) + 1;
+  grid.numrows = grid.numcolumns;
+  grid.scalex = (maxx > grid.minx) ? grid.numcolumns / (maxx - grid.minx) : 0;
+  grid.scaley = (maxy > grid.miny) ? grid.numrows / (maxy - grid.miny) : 0;
+  numcells = grid.numcolumns * grid.numrows;
+  grid.cells = workspace.Get(workspace.gridcells, numcells);
+  for (j = 0; j < numcells; j++) {
+    grid.cells[j] = -1;
+  }
+  grid.entries = workspace.gridentries.data;
+  grid.numentries = 0;
+  for (j = 0; j < numvertices; j++) {
+    if (grid.next[j] >= 0) {
+      InsertGridEdge(&grid, j);
+    }
+  }
+
+  for (i = 0; i < numholes; i++) {
+    holepoint = grid.points[holes[i].vertex];
+    vertex = FindHoleBridge(&grid, holepoint);
+    if (vertex < 0) {
+      vertex = FindHoleBridgeSlow(&grid, holepoint, numvertices);
+    }
+    if (vertex < 0) {
+      return 0;
+    }
+
+    // Splice the hole in as ... -> copy of vertex -> hole vertex -> ... ->
+    // copy of hole vertex -> vertex -> ..., so the edges already in the
+    // grid keep their starting vertex.
+    start = polystarts[holes[i].poly];
+    count = polystarts[holes[i].poly + 1] - start;
+    for (j = 0; j < count; j++) {
+      grid.previous[start + j] = start + (j + count - 1) % count;
+      grid.next[start + j] = start + (j + 1) % count;
+    }
+    vertexcopy = numvertices;
+    holecopy = numvertices + 1;
+    numvertices += 2;
+    grid.points[vertexcopy] = grid.points[vertex];
+    grid.points[holecopy] = holepoint;
+    last = grid.previous[holes[i].vertex];
+
+    grid.next[grid.previous[vertex]] = vertexcopy;
+    grid.previous[vertexcopy] = grid.previous[vertex];
+    grid.next[vertexcopy] = holes[i].vertex;
+    grid.previous[holes[i].vertex] = vertexcopy;
+    grid.next[last] = holecopy;
+    grid.previous[holecopy] = last;
+    grid.next[holecopy] = vertex;
+    grid.previous[vertex] = holecopy;
+
+    InsertGridEdge(&grid, vertexcopy);
+    InsertGridEdge(&grid, holecopy);
+    for (j = start; j < start + count; j++) {
+      InsertGridEdge(&grid, j);
+    }
+  }
+
+  // Write out the rings of the non-hole polygons, starting at their first
+  // vertex.
+  i = 0;
+  for (iter = inpolys->begin(); iter != inpolys->end(); iter++, i++) {
+    if (iter->IsHole()) {
+      continue;
+    }
+    start = polystarts[i];
+    count = polystarts[i + 1] - start;
+    if (count == 0) {
+      outpolys->push_back(*iter);
+      continue;
+    }
+    count = 1;
+    for (vertex = grid.next[start]; vertex != start; vertex = grid.next[vertex]) {
+      count++;
+    }
+    if (count == iter->GetNumPoints()) {
+      outpolys->push_back(*iter);
+      continue;
+    }
+    newpoly.Init(count);
+    vertex = start;
+    for (j = 0; j < count; j++) {
+      newpoly[j] = grid.points[vertex];
+      vertex = grid.next[vertex];
+    }
+    outpolys->push_back(std::move(newpoly));
+  }
+
+  return 1;
+}
+
+#ifdef TPPL_USE_INT32
+// Computes the 128-bit product of a and b.
+void TPPLPartition::Multiply128(uint64_t a, uint64_t b, uint64_t *high, uint64_t *low) {
+  uint64_t a0, a1, b0, b1, p00, p01, p10, p11, middle;
+
+  a0 = a & 0xFFFFFFFF;
+  a1 = a >> 32;
+  b0 = b & 0xFFFFFFFF;
+  b1 = b >> 32;
+  p00 = a0 * b0;
+  p01 = a0 * b1;
+  p10 = a1 * b0;
+  p11 = a1 * b1;
+  middle = (p00 >> 32) + (p01 & 0xFFFFFFFF) + (p10 & 0xFFFFFFFF);
+  *low = (middle << 32) | (p00 & 0xFFFFFFFF);
+  *high = p11 + (p01 >> 32) + (p10 >> 32) + (middle >> 32);
+}
+
+// Returns the sign of a * b - c * d for 33-bit signed a, b, c and d.
+int TPPLPartition::ProductDifferenceSign(int64_t a, int64_t b, int64_t c, int64_t d) {
+  const int64_t limit = (int64_t)1 << 31;
+  int left, right, order;
+  uint64_t lefthigh, leftlow, righthigh, rightlow;
+
+  // Products of values below 2^31 fit in 63 bits, their difference
+  // in 64 bits.
+  if ((a < limit) && (a > -limit) && (b < limit) && (b > -limit) &&
+          (c < limit) && (c > -limit) && (d < limit) && (d > -limit)) {
+    int64_t det = a * b - c * d;
+    return (det > 0) ? 1 : ((det < 0) ? -1 : 0);
+  }
+
+  left = ((a > 0) - (a < 0)) * ((b > 0) - (b < 0));
+  right = ((c > 0) - (c < 0)) * ((d > 0) - (d < 0));
+  if (left != right) {
+    return (left > right) ? 1 : -1;
+  }
+  if (left == 0) {
+    return 0;
+  }
+
+  // Same sign, compare the magnitudes.
+  Multiply128((uint64_t)(a < 0 ? -a : a), (uint64_t)(b < 0 ? -b : b), &lefthigh, &leftlow);
+  Multiply128((uint64_t)(c < 0 ? -c : c), (uint64_t)(d < 0 ? -d : d), &righthigh, &rightlow);
+  if (lefthigh != righthigh) {
+    order = (lefthigh > righthigh) ? 1 : -1;
+  } else if (leftlow != rightlow) {
+    order = (leftlow > rightlow) ? 1 : -1;
+  } else {
+    order = 0;
+  }
+  return left * order;
+}
+#endif
+
+#ifndef TPPL_USE_INT32
+// Evaluates the sign of the orientation determinant exactly, expanding it
+// into six products of coordinates, each split into a rounded product and
+// its rounding error. The twelve terms are summed into an expansion of
+// non-overlapping components of increasing magnitude, whose largest
+// nonzero component gives the sign.
+int TPPLPartition::OrientationExact(const TPPLPoint &p1, const TPPLPoint &p2, const TPPLPoint &p3) {
+  // 2^27 + 1, splits a double into two halves of 26 bits.
+  const double splitter = 134217729.0;
+  double factors[12], terms[12], expansion[12];
+  double a, b, c, ahigh, alow, bhigh, blow, product, sum, avirtual, bvirtual;
+  long i, j, numcomponents;
+
+  factors[0] = p3.y;
+  factors[1] = p2.x;
+  factors[2] = -(double)p3.y;
+  factors[3] = p1.x;
+  factors[4] = -(double)p1.y;
+  factors[5] = p2.x;
+  factors[6] = -(double)p3.x;
+  factors[7] = p2.y;
+  factors[8] = p3.x;
+  factors[9] = p1.y;
+  factors[10] = p1.x;
+  factors[11] = p2.y;
+
+  for (i = 0; i < 6; i++) {
+    a = factors[2 * i];
+    b = factors[2 * i + 1];
+    product = a * b;
+    c = splitter * a;
+    ahigh = c - (c - a);
+    alow = a - ahigh;
+    c = splitter * b;
+    bhigh = c - (c - b);
+    blow = b - bhigh;
+    terms[2 * i] = product;
+    terms[2 * i + 1] = alow * blow - (((product - ahigh * bhigh) - alow * bhigh) - ahigh * blow);
+  }
+
+  numcomponents = 0;
+  for (i = 0; i < 12; i++) {
+    sum = terms[i];
+    for (j = 0; j < numcomponents; j++) {
+      a = sum;
+      b = expansion[j];
+      sum = a + b;
+      bvirtual = sum - a;
+      avirtual = sum - bvirtual;
+      expansion[j] = (a - avirtual) + (b - bvirtual);
+    }
+    expansion[numcomponents++] = sum;
+  }
+  for (i = numcomponents - 1; i >= 0; i--) {
+    if (expansion[i] != 0) {
+      return (expansion[i] > 0) ? 1 : -1;
+    }
+  }
+  return 0;
+}
+#endif
+
+int TPPLPartition::Orientation(const TPPLPoint &p1, const TPPLPoint &p2, const TPPLPoint &p3) {
+#if defined(TPPL_USE_INT32)
+  // Differences of 32-bit coordinates take 33 bits, so the determinant
+  // is evaluated exactly in integers.
+  return ProductDifferenceSign((int64_t)p3.y - p1.y, (int64_t)p2.x - p1.x,
+          (int64_t)p3.x - p1.x, (int64_t)p2.y - p1.y);
+#else
+  // Shewchuk's orient2d filter: the determinant is trusted when it cannot
+  // have changed sign through rounding, which covers nearly all calls.
+  // Float coordinates are evaluated in double as well.
+  const double epsilon = 1.1102230246251565e-16;
+  const double errorbound = (3 + 16 * epsilon) * epsilon;
+  double left, right, det, detsum;
+
+  left = ((double)p3.y - p1.y) * ((double)p2.x - p1.x);
+  right = ((double)p3.x - p1.x) * ((double)p2.y - p1.y);
+  det = left - right;
+  detsum = fabs(left) + fabs(right);
+  if (fabs(det) > errorbound * detsum) {
+    return (det > 0) ? 1 : -1;
+  }
+  if (detsum == 0) {
+    return 0;
+  }
+  return OrientationExact(p1, p2, p3);
+#endif
+}
+
+bool TPPLPartition::IsConvex(TPPLPoint &p1, TPPLPoint &p2, TPPLPoint &p3) {
+  return Orientation(p1, p2, p3) > 0;
+}
+
+bool TPPLPartition::IsReflex(TPPLPoint &p1, TPPLPoint &p2, TPPLPoint &p3) {
+  return Orientation(p1, p2, p3) < 0;
+}
+
+bool TPPLPartition::IsInside(TPPLPoint &p1, TPPLPoint &p2, TPPLPoint &p3, TPPLPoint &p) {
+  if (IsConvex(p1, p, p2)) {
+    return false;
+  }
+  if (IsConvex(p2, p, p3)) {
+    return false;
+  }
+  if (IsConvex(p3, p, p1)) {
+    return false;
+  }
+  return true;
+}
+
+bool TPPLPartition::InCone(TPPLPoint &p1, TPPLPoint &p2, TPPLPoint &p3, TPPLPoint &p) {
+  bool convex;
+
+  convex = IsConvex(p1, p2, p3);
+
+  if (convex) {
+    if (!IsConvex(p1, p2, p)) {
+      return false;
+    }
+    if (!IsConvex(p2, p3, p)) {
+      return false;
     }
     return true;
   } else {
@@ -382,76 +1504,704 @@ bool TPPLPartition::InCone(PartitionVertex *v, TPPLPoint &p) {
   return InCone(p1, p2, p3, p);
 }
 
-void TPPLPartition::UpdateVertexReflexity(PartitionVertex *v) {
-  PartitionVertex *v1 = NULL, *v3 = NULL;
-  v1 = v->previous;
-  v3 = v->next;
-  v->isConvex = !IsReflex(v1->p, v->p, v3->p);
+void TPPLPartition::ClassifyVertices(const TPPLPoint *points, long stride, long numpoints, signed char *orientations) {
+  const char *base = (const char *)points;
+  long i, next;
+
+  i = 1;
+#ifdef TPPL_SIMD
+  static const bool avx = HasAVX();
+  if (avx) {
+    i = ClassifyVerticesAVX(points, stride, numpoints, orientations);
+  } else {
+    i = ClassifyVerticesSSE2(points, stride, numpoints, orientations);
+  }
+#endif
+  for (; i < numpoints; i++) {
+    next = (i == (numpoints - 1)) ? 0 : (i + 1);
+    orientations[i] = (signed char)Orientation(*(const TPPLPoint *)(base + (i - 1) * stride),
+            *(const TPPLPoint *)(base + i * stride), *(const TPPLPoint *)(base + next * stride));
+  }
+  orientations[0] = (signed char)Orientation(*(const TPPLPoint *)(base + (numpoints - 1) * stride),
+          points[0], *(const TPPLPoint *)(base + stride));
 }
 
-void TPPLPartition::UpdateVertex(PartitionVertex *v, PartitionVertex *vertices, long numvertices) {
-  long i;
-  PartitionVertex *v1 = NULL, *v3 = NULL;
-  TPPLPoint vec1, vec3;
+#ifdef TPPL_SIMD
+bool TPPLPartition::HasAVX() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  // AVX and OS support for saving its registers.
+  if (((info[2] >> 27) & 1) && ((info[2] >> 28) & 1)) {
+    return (_xgetbv(0) & 6) == 6;
+  }
+  return false;
+#else
+  return __builtin_cpu_supports("avx");
+#endif
+}
 
-  v1 = v->previous;
-  v3 = v->next;
+// Evaluates Orientation for two vertices at once, with the same filter.
+// Vertices whose sign the filter can't decide go through Orientation.
+long TPPLPartition::ClassifyVerticesSSE2(const TPPLPoint *points, long stride, long numpoints, signed char *orientations) {
+  const double epsilon = 1.1102230246251565e-16;
+  const char *base = (const char *)points;
+  const TPPLPoint *p[4];
+  __m128d previousx, previousy, currentx, currenty, nextx, nexty;
+  __m128d left, right, det, detsum, absmask, bound, zero;
+  long i, lane;
+  int certain, positive;
+
+  absmask = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+  bound = _mm_set1_pd((3 + 16 * epsilon) * epsilon);
+  zero = _mm_setzero_pd();
+  for (i = 1; i + 2 < numpoints; i += 2) {
+    for (lane = 0; lane < 4; lane++) {
+      p[lane] = (const TPPLPoint *)(base + (i - 1 + lane) * stride);
+    }
+    previousx = _mm_set_pd(p[1]->x, p[0]->x);
+    previousy = _mm_set_pd(p[1]->y, p[0]->y);
+    currentx = _mm_set_pd(p[2]->x, p[1]->x);
+    currenty = _mm_set_pd(p[2]->y, p[1]->y);
+    nextx = _mm_set_pd(p[3]->x, p[2]->x);
+    nexty = _mm_set_pd(p[3]->y, p[2]->y);
+
+    left = _mm_mul_pd(_mm_sub_pd(nexty, previousy), _mm_sub_pd(currentx, previousx));
+    right = _mm_mul_pd(_mm_sub_pd(nextx, previousx), _mm_sub_pd(currenty, previousy));
+    det = _mm_sub_pd(left, right);
+    detsum = _mm_add_pd(_mm_and_pd(left, absmask), _mm_and_pd(right, absmask));
+    certain = _mm_movemask_pd(_mm_cmpgt_pd(_mm_and_pd(det, absmask), _mm_mul_pd(bound, detsum)));
+    positive = _mm_movemask_pd(_mm_cmpgt_pd(det, zero));
+
+    for (lane = 0; lane < 2; lane++) {
+      if ((certain >> lane) & 1) {
+        orientations[i + lane] = ((positive >> lane) & 1) ? 1 : -1;
+      } else {
+        orientations[i + lane] = (signed char)Orientation(*p[lane], *p[lane + 1], *p[lane + 2]);
+      }
+    }
+  }
+  return i;
+}
 
-  v->isConvex = IsConvex(v1->p, v->p, v3->p);
+// Same as ClassifyVerticesSSE2, four vertices at once.
+TPPL_TARGET_AVX long TPPLPartition::ClassifyVerticesAVX(const TPPLPoint *points, long stride, long numpoints, signed char *orientations) {
+  const double epsilon = 1.1102230246251565e-16;
+  const char *base = (const char *)points;
+  const TPPLPoint *p[6];
+  __m256d previousx, previousy, currentx, currenty, nextx, nexty;
+  __m256d left, right, det, detsum, absmask, bound, zero;
+  long i, lane;
+  int certain, positive;
+
+  absmask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+  bound = _mm256_set1_pd((3 + 16 * epsilon) * epsilon);
+  zero = _mm256_setzero_pd();
+  for (i = 1; i + 4 < numpoints; i += 4) {
+    for (lane = 0; lane < 6; lane++) {
+      p[lane] = (const TPPLPoint *)(base + (i - 1 + lane) * stride);
+    }
+    previousx = _mm256_set_pd(p[3]->x, p[2]->x, p[1]->x, p[0]->x);
+    previousy = _mm256_set_pd(p[3]->y, p[2]->y, p[1]->y, p[0]->y);
+    currentx = _mm256_set_pd(p[4]->x, p[3]->x, p[2]->x, p[1]->x);
+    currenty = _mm256_set_pd(p[4]->y, p[3]->y, p[2]->y, p[1]->y);
+    nextx = _mm256_set_pd(p[5]->x, p[4]->x, p[3]->x, p[2]->x);
+    nexty = _mm256_set_pd(p[5]->y, p[4]->y, p[3]->y, p[2]->y);
+
+    left = _mm256_mul_pd(_mm256_sub_pd(nexty, previousy), _mm256_sub_pd(currentx, previousx));
+    right = _mm256_mul_pd(_mm256_sub_pd(nextx, previousx), _mm256_sub_pd(currenty, previousy));
+    det = _mm256_sub_pd(left, right);
+    detsum = _mm256_add_pd(_mm256_and_pd(left, absmask), _mm256_and_pd(right, absmask));
+    certain = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_and_pd(det, absmask), _mm256_mul_pd(bound, detsum), _CMP_GT_OQ));
+    positive = _mm256_movemask_pd(_mm256_cmp_pd(det, zero, _CMP_GT_OQ));
+
+    for (lane = 0; lane < 4; lane++) {
+      if ((certain >> lane) & 1) {
+        orientations[i + lane] = ((positive >> lane) & 1) ? 1 : -1;
+      } else {
+        orientations[i + lane] = (signed char)Orientation(*p[lane], *p[lane + 1], *p[lane + 2]);
+      }
+    }
+  }
+  return i;
+}
 
-  vec1 = Normalize(v1->p - v->p);
-  vec3 = Normalize(v3->p - v->p);
-  v->angle = vec1.x * vec3.x + vec1.y * vec3.y;
+// Tests two points at once against the triangle, with the filter of
+// Orientation on each of the three edge tests. Points the filter can't
+// decide go through IsInside.
+long TPPLPartition::FindPointInsideSSE2(const TPPLPoint &p1, const TPPLPoint &p2, const TPPLPoint &p3,
+        const double *xs, const double *ys, long numpoints) {
+  const double epsilon = 1.1102230246251565e-16;
+  const TPPLPoint *corners[3] = { &p1, &p2, &p3 };
+  TPPLPoint a = p1, b = p2, c = p3, p;
+  __m128d x, y, left, right, det, absmask, bound, zero, ones, outside, inside, excluded;
+  __m128d cornerx[3], cornery[3], edgex[3], edgey[3];
+  long i, k, lane;
+  int hits, certain;
+
+  absmask = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+  bound = _mm_set1_pd((3 + 16 * epsilon) * epsilon);
+  zero = _mm_setzero_pd();
+  ones = _mm_castsi128_pd(_mm_set1_epi64x(-1));
+  for (k = 0; k < 3; k++) {
+    cornerx[k] = _mm_set1_pd(corners[k]->x);
+    cornery[k] = _mm_set1_pd(corners[k]->y);
+    edgex[k] = _mm_set1_pd(corners[(k + 1) % 3]->x - corners[k]->x);
+    edgey[k] = _mm_set1_pd(corners[(k + 1) % 3]->y - corners[k]->y);
+  }
 
-  if (v->isConvex) {
-    v->isEar = true;
-    for (i = 0; i < numvertices; i++) {
-      if ((vertices[i].p.x == v->p.x) && (vertices[i].p.y == v->p.y)) {
+  for (i = 0; i + 2 <= numpoints; i += 2) {
+    x = _mm_loadu_pd(xs + i);
+    y = _mm_loadu_pd(ys + i);
+    outside = zero;
+    inside = ones;
+    excluded = zero;
+    for (k = 0; k < 3; k++) {
+      // Orientation of the edge start, the point and the edge end.
+      left = _mm_mul_pd(edgey[k], _mm_sub_pd(x, cornerx[k]));
+      right = _mm_mul_pd(edgex[k], _mm_sub_pd(y, cornery[k]));
+      det = _mm_sub_pd(left, right);
+      det = _mm_and_pd(det, _mm_cmpgt_pd(_mm_and_pd(det, absmask),
+              _mm_mul_pd(bound, _mm_add_pd(_mm_and_pd(left, absmask), _mm_and_pd(right, absmask)))));
+      outside = _mm_or_pd(outside, _mm_cmpgt_pd(det, zero));
+      inside = _mm_and_pd(inside, _mm_cmplt_pd(det, zero));
+      excluded = _mm_or_pd(excluded, _mm_and_pd(_mm_cmpeq_pd(x, cornerx[k]), _mm_cmpeq_pd(y, cornery[k])));
+    }
+    // Points neither certainly outside nor a corner.
+    hits = ~_mm_movemask_pd(_mm_or_pd(outside, excluded)) & 0x3;
+    if (hits == 0) {
+      continue;
+    }
+    certain = _mm_movemask_pd(inside);
+    for (lane = 0; lane < 2; lane++) {
+      if (!((hits >> lane) & 1)) {
         continue;
       }
-      if ((vertices[i].p.x == v1->p.x) && (vertices[i].p.y == v1->p.y)) {
-        continue;
+      p.x = xs[i + lane];
+      p.y = ys[i + lane];
+      if (((certain >> lane) & 1) || IsInside(a, b, c, p)) {
+        return -1;
       }
-      if ((vertices[i].p.x == v3->p.x) && (vertices[i].p.y == v3->p.y)) {
+    }
+  }
+  return i;
+}
+
+// Same as FindPointInsideSSE2, four points at once.
+TPPL_TARGET_AVX long TPPLPartition::FindPointInsideAVX(const TPPLPoint &p1, const TPPLPoint &p2, const TPPLPoint &p3,
+        const double *xs, const double *ys, long numpoints) {
+  const double epsilon = 1.1102230246251565e-16;
+  const TPPLPoint *corners[3] = { &p1, &p2, &p3 };
+  TPPLPoint a = p1, b = p2, c = p3, p;
+  __m256d x, y, left, right, det, absmask, bound, zero, ones, outside, inside, excluded;
+  __m256d cornerx[3], cornery[3], edgex[3], edgey[3];
+  long i, k, lane;
+  int hits, certain;
+
+  absmask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+  bound = _mm256_set1_pd((3 + 16 * epsilon) * epsilon);
+  zero = _mm256_setzero_pd();
+  ones = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+  for (k = 0; k < 3; k++) {
+    cornerx[k] = _mm256_set1_pd(corners[k]->x);
+    cornery[k] = _mm256_set1_pd(corners[k]->y);
+    edgex[k] = _mm256_set1_pd(corners[(k + 1) % 3]->x - corners[k]->x);
+    edgey[k] = _mm256_set1_pd(corners[(k + 1) % 3]->y - corners[k]->y);
+  }
+
+  for (i = 0; i + 4 <= numpoints; i += 4) {
+    x = _mm256_loadu_pd(xs + i);
+    y = _mm256_loadu_pd(ys + i);
+    outside = zero;
+    inside = ones;
+    excluded = zero;
+    for (k = 0; k < 3; k++) {
+      // Orientation of the edge start, the point and the edge end.
+      left = _mm256_mul_pd(edgey[k], _mm256_sub_pd(x, cornerx[k]));
+      right = _mm256_mul_pd(edgex[k], _mm256_sub_pd(y, cornery[k]));
+      det = _mm256_sub_pd(left, right);
+      det = _mm256_and_pd(det, _mm256_cmp_pd(_mm256_and_pd(det, absmask),
+              _mm256_mul_pd(bound, _mm256_add_pd(_mm256_and_pd(left, absmask), _mm256_and_pd(right, absmask))), _CMP_GT_OQ));
+      outside = _mm256_or_pd(outside, _mm256_cmp_pd(det, zero, _CMP_GT_OQ));
+      inside = _mm256_and_pd(inside, _mm256_cmp_pd(det, zero, _CMP_LT_OQ));
+      excluded = _mm256_or_pd(excluded, _mm256_and_pd(_mm256_cmp_pd(x, cornerx[k], _CMP_EQ_OQ), _mm256_cmp_pd(y, cornery[k], _CMP_EQ_OQ)));
+    }
+    // Points neither certainly outside nor a corner.
+    hits = ~_mm256_movemask_pd(_mm256_or_pd(outside, excluded)) & 0xF;
+    if (hits == 0) {
+      continue;
+    }
+    certain = _mm256_movemask_pd(inside);
+    for (lane = 0; lane < 4; lane++) {
+      if (!((hits >> lane) & 1)) {
         continue;
       }
-      if (IsInside(v1->p, v->p, v3->p, vertices[i].p)) {
-        v->isEar = false;
-        break;
+      p.x = xs[i + lane];
+      p.y = ys[i + lane];
+      if (((certain >> lane) & 1) || IsInside(a, b, c, p)) {
+        return -1;
       }
     }
+  }
+  return i;
+}
+#endif
+
+void TPPLPartition::UpdateVertex(EarPolygon *polygon, EarHeap *heap, long vertex) {
+  const TPPLPoint *points = polygon->points;
+  UpdateEar(polygon, heap, vertex,
+          Orientation(points[polygon->previous[vertex]], points[vertex], points[polygon->next[vertex]]) > 0);
+}
+
+void TPPLPartition::UpdateEar(EarPolygon *polygon, EarHeap *heap, long vertex, bool isconvex) {
+  const TPPLPoint &p = polygon->points[vertex];
+  const TPPLPoint &p1 = polygon->points[polygon->previous[vertex]];
+  const TPPLPoint &p3 = polygon->points[polygon->next[vertex]];
+  bool isear;
+
+  isear = isconvex && !AnyPointInside(p1, p, p3, polygon->xs, polygon->ys, polygon->numvertices);
+  UpdateEarHeap(heap, vertex, isear, Cosine(p, p1, p3));
+}
+
+bool TPPLPartition::AnyPointInside(const TPPLPoint &p1, const TPPLPoint &p2, const TPPLPoint &p3,
+        const tppl_coord *xs, const tppl_coord *ys, long numpoints) {
+  TPPLPoint a = p1, b = p2, c = p3, p;
+  long i;
+
+  i = 0;
+#ifdef TPPL_SIMD
+  static const bool avx = HasAVX();
+  if (avx) {
+    i = FindPointInsideAVX(p1, p2, p3, xs, ys, numpoints);
   } else {
-    v->isEar = false;
+    i = FindPointInsideSSE2(p1, p2, p3, xs, ys, numpoints);
+  }
+  if (i < 0) {
+    return true;
+  }
+#endif
+  for (; i < numpoints; i++) {
+    if ((xs[i] == p1.x) && (ys[i] == p1.y)) {
+      continue;
+    }
+    if ((xs[i] == p2.x) && (ys[i] == p2.y)) {
+      continue;
+    }
+    if ((xs[i] == p3.x) && (ys[i] == p3.y)) {
+      continue;
+    }
+    p.x = xs[i];
+    p.y = ys[i];
+    if (IsInside(a, b, c, p)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void TPPLPartition::AddTriangle(uint32_t *indices, long *numtriangles, long i1, long i2, long i3) {
+  uint32_t *triangle = indices + 3 * (*numtriangles);
+  triangle[0] = (uint32_t)i1;
+  triangle[1] = (uint32_t)i2;
+  triangle[2] = (uint32_t)i3;
+  (*numtriangles)++;
+}
+
+void TPPLPartition::AddTriangles(TPPLPoint *points, uint32_t *indices, long numtriangles, TPPLPolyList *triangles) {
+  TPPLPoly triangle;
+  long i;
+
+  for (i = 0; i < numtriangles; i++) {
+    triangle.Triangle(points[indices[3 * i]], points[indices[3 * i + 1]], points[indices[3 * i + 2]]);
+    triangles->push_back(std::move(triangle));
   }
 }
 
 // Triangulation by ear removal.
-int TPPLPartition::Triangulate_EC(TPPLPoly *poly, TPPLPolyList *triangles) {
+// Whether ear a should be clipped before ear b. Ties go to the lower index,
+// as when scanning the vertices in order.
+bool TPPLPartition::EarBefore(EarHeap *heap, long a, long b) {
+  if (heap->angles[a] != heap->angles[b]) {
+    return heap->angles[a] > heap->angles[b];
+  }
+  return a < b;
+}
+
+void TPPLPartition::SiftEarUp(EarHeap *heap, long position) {
+  long vertex, parent;
+
+  vertex = heap->heap[position];
+  while (position > 0) {
+    parent = (position - 1) / 2;
+    if (!EarBefore(heap, vertex, heap->heap[parent])) {
+      break;
+    }
+    heap->heap[position] = heap->heap[parent];
+    heap->positions[heap->heap[position]] = position;
+    position = parent;
+  }
+  heap->heap[position] = vertex;
+  heap->positions[vertex] = position;
+}
+
+void TPPLPartition::SiftEarDown(EarHeap *heap, long position) {
+  long vertex, child;
+
+  vertex = heap->heap[position];
+  for (;;) {
+    child = 2 * position + 1;
+    if (child >= heap->size) {
+      break;
+    }
+    if ((child + 1 < heap->size) && EarBefore(heap, heap->heap[child + 1], heap->heap[child])) {
+      child++;
+    }
+    if (!EarBefore(heap, heap->heap[child], vertex)) {
+      break;
+    }
+    heap->heap[position] = heap->heap[child];
+    heap->positions[heap->heap[position]] = position;
+    position = child;
+  }
+  heap->heap[position] = vertex;
+  heap->positions[vertex] = position;
+}
+
+// Inserts, moves or removes a vertex in the ear heap after its ear status
+// or angle have changed.
+void TPPLPartition::UpdateEarHeap(EarHeap *heap, long vertex, bool isear, tppl_float angle) {
+  long position, last;
+
+  position = heap->positions[vertex];
+  if (isear) {
+    heap->angles[vertex] = angle;
+    if (position < 0) {
+      position = heap->size;
+      heap->heap[position] = vertex;
+      heap->size++;
+    }
+    SiftEarUp(heap, position);
+    SiftEarDown(heap, heap->positions[vertex]);
+  } else if (position >= 0) {
+    heap->positions[vertex] = -1;
+    heap->size--;
+    if (position < heap->size) {
+      last = heap->heap[heap->size];
+      heap->heap[position] = last;
+      SiftEarUp(heap, position);
+      SiftEarDown(heap, heap->positions[last]);
+    }
+  }
+}
+
+int TPPLPartition::Triangulate_EC(TPPLPoly *poly, uint32_t *indices, long *numtriangles) {
+  *numtriangles = 0;
   if (!poly->Valid()) {
     return 0;
   }
 
   long numvertices;
-  PartitionVertex *vertices = NULL;
-  PartitionVertex *ear = NULL;
-  TPPLPoly triangle;
-  long i, j;
-  bool earfound;
+  EarPolygon polygon;
+  EarHeap earheap;
+  signed char *orientations = NULL;
+  tppl_coord *xs = NULL, *ys = NULL;
+  long i, ear, previous, next;
 
   if (poly->GetNumPoints() < 3) {
     return 0;
   }
   if (poly->GetNumPoints() == 3) {
-    triangles->push_back(*poly);
+    AddTriangle(indices, numtriangles, 0, 1, 2);
     return 1;
   }
 
   numvertices = poly->GetNumPoints();
 
-  vertices = new PartitionVertex[numvertices];
+  polygon.points = poly->GetPoints();
+  polygon.numvertices = numvertices;
+  polygon.previous = workspace.Get(workspace.earprevious, numvertices);
+  polygon.next = workspace.Get(workspace.earnext, numvertices);
+  polygon.active = workspace.Get(workspace.earactive, numvertices);
+  xs = workspace.Get(workspace.pointsx, numvertices);
+  ys = workspace.Get(workspace.pointsy, numvertices);
+  for (i = 0; i < numvertices; i++) {
+    polygon.previous[i] = (int32_t)((i == 0) ? (numvertices - 1) : (i - 1));
+    polygon.next[i] = (int32_t)((i == (numvertices - 1)) ? 0 : (i + 1));
+    polygon.active[i] = 1;
+    xs[i] = polygon.points[i].x;
+    ys[i] = polygon.points[i].y;
+  }
+  polygon.xs = xs;
+  polygon.ys = ys;
+
+  orientations = workspace.Get(workspace.orientations, numvertices);
+  ClassifyVertices(polygon.points, sizeof(TPPLPoint), numvertices, orientations);
+  earheap.heap = workspace.Get(workspace.earheap, numvertices);
+  earheap.positions = workspace.Get(workspace.earheappositions, numvertices);
+  earheap.angles = workspace.Get(workspace.earheapangles, numvertices);
+  earheap.size = 0;
+  for (i = 0; i < numvertices; i++) {
+    earheap.positions[i] = -1;
+    UpdateEar(&polygon, &earheap, i, orientations[i] > 0);
+  }
+
+  for (i = 0; i < numvertices - 3; i++) {
+    // Find the most extruded ear.
+    if (earheap.size == 0) {
+      return 0;
+    }
+    ear = earheap.heap[0];
+    previous = polygon.previous[ear];
+    next = polygon.next[ear];
+
+    AddTriangle(indices, numtriangles, previous, ear, next);
+
+    polygon.active[ear] = 0;
+    polygon.next[previous] = (int32_t)next;
+    polygon.previous[next] = (int32_t)previous;
+
+    if (i == numvertices - 4) {
+      break;
+    }
+
+    UpdateEarHeap(&earheap, ear, false, 0);
+    UpdateVertex(&polygon, &earheap, previous);
+    UpdateVertex(&polygon, &earheap, next);
+  }
+  for (i = 0; i < numvertices; i++) {
+    if (polygon.active[i]) {
+      AddTriangle(indices, numtriangles, polygon.previous[i], i, polygon.next[i]);
+      break;
+    }
+  }
+
+  return 1;
+}
+
+int TPPLPartition::Triangulate_EC(TPPLPoly *poly, TPPLPolyList *triangles) {
+  if (!poly->Valid()) {
+    return 0;
+  }
+  if (poly->GetNumPoints() == 3) {
+    triangles->push_back(*poly);
+    return 1;
+  }
+
+  uint32_t *indices = workspace.Get(workspace.indices, 3 * (poly->GetNumPoints() - 2));
+  long numtriangles;
+  int ret;
+
+  ret = Triangulate_EC(poly, indices, &numtriangles);
+  AddTriangles(poly->GetPoints(), indices, numtriangles, triangles);
+
+  return ret;
+}
+
+int TPPLPartition::Triangulate_EC(TPPLPolyList *inpolys, TPPLPolyList *triangles) {
+  TPPLPolyList outpolys;
+  TPPLPolyList::iterator iter;
+
+  if (!RemoveHoles_Grid(inpolys, &outpolys)) {
+    return 0;
+  }
+  for (iter = outpolys.begin(); iter != outpolys.end(); iter++) {
+    if (!Triangulate_EC(&(*iter), triangles)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int TPPLPartition::Triangulate_EC(TPPLPolyList *groups, long numgroups, TPPLPolyList *triangles, int *statuses) {
+  return RunBatch(BATCH_TRIANGULATE_EC, groups, numgroups, triangles, statuses);
+}
+
+uint32_t TPPLPartition::ZOrder(ReflexIndex *index, const TPPLPoint &p) {
+  tppl_float fx, fy;
+  uint32_t x, y;
+
+  // Quantize to 16 bits per coordinate within the bounding box.
+  fx = (p.x - index->minx) * index->scale;
+  fy = (p.y - index->miny) * index->scale;
+  x = (fx <= 0) ? 0 : ((fx >= 65535) ? 65535 : (uint32_t)fx);
+  y = (fy <= 0) ? 0 : ((fy >= 65535) ? 65535 : (uint32_t)fy);
+
+  // Interleave the bits of x and y.
+  x = (x | (x << 8)) & 0x00FF00FF;
+  x = (x | (x << 4)) & 0x0F0F0F0F;
+  x = (x | (x << 2)) & 0x33333333;
+  x = (x | (x << 1)) & 0x55555555;
+  y = (y | (y << 8)) & 0x00FF00FF;
+  y = (y | (y << 4)) & 0x0F0F0F0F;
+  y = (y | (y << 2)) & 0x33333333;
+  y = (y | (y << 1)) & 0x55555555;
+
+  return x | (y << 1);
+}
+
+// Returns the smallest Morton code greater than z that lies in the box
+// spanned by zmin and zmax, or z if z itself lies in the box.
+uint32_t TPPLPartition::ZOrderBigMin(uint32_t z, uint32_t zmin, uint32_t zmax) {
+  uint32_t bigmin, bit, lower;
+  int i;
+
+  if (((z & 0x55555555) >= (zmin & 0x55555555)) && ((z & 0x55555555) <= (zmax & 0x55555555)) &&
+      ((z & 0xAAAAAAAA) >= (zmin & 0xAAAAAAAA)) && ((z & 0xAAAAAAAA) <= (zmax & 0xAAAAAAAA))) {
+    return z;
+  }
+
+  bigmin = zmax;
+  for (i = 31; i >= 0; i--) {
+    bit = (uint32_t)1 << i;
+    // Lower bits of the same coordinate.
+    lower = (bit - 1) & ((i & 1) ? 0xAAAAAAAA : 0x55555555);
+    if (z & bit) {
+      if (!(zmin & bit)) {
+        if (!(zmax & bit)) {
+          return bigmin;
+        }
+        zmin = (zmin | bit) & ~lower;
+      }
+    } else {
+      if (zmin & bit) {
+        return zmin;
+      }
+      if (zmax & bit) {
+        bigmin = (zmin | bit) & ~lower;
+        zmax = (zmax & ~bit) | lower;
+      }
+    }
+  }
+  return bigmin;
+}
+
+long TPPLPartition::NextReflexEntry(ReflexIndex *index, long entry) {
+  long *skip = index->skip;
+  while (skip[entry] != entry) {
+    skip[entry] = skip[skip[entry]];
+    entry = skip[entry];
+  }
+  return entry;
+}
+
+void TPPLPartition::RemoveReflexVertex(ReflexIndex *index, long vertex) {
+  long entry = index->positions[vertex];
+  if (entry < 0) {
+    return;
+  }
+  index->skip[entry] = entry + 1;
+  index->positions[vertex] = -1;
+}
+
+void TPPLPartition::UpdateVertexZ(PartitionVertex *v, PartitionVertex *vertices, ReflexIndex *index, bool updateangle) {
+  PartitionVertex *v1 = NULL, *v3 = NULL;
+  TPPLPoint *p = NULL;
+  tppl_coord minx, miny, maxx, maxy;
+  uint32_t z, zmin, zmax, bigmin;
+  TPPLPoint corner;
+  long entry;
+
+  v1 = v->previous;
+  v3 = v->next;
+
+  v->isConvex = IsConvex(v1->p, v->p, v3->p);
+
+  if (updateangle) {
+    v->angle = Cosine(v->p, v1->p, v3->p);
+  }
+
+  if (!v->isConvex) {
+    v->isEar = false;
+    return;
+  }
+
+  // Convex vertices stay convex as ears are clipped, so this one is done.
+  RemoveReflexVertex(index, v - vertices);
+
+  minx = std::min(v1->p.x, std::min(v->p.x, v3->p.x));
+  miny = std::min(v1->p.y, std::min(v->p.y, v3->p.y));
+  maxx = std::max(v1->p.x, std::max(v->p.x, v3->p.x));
+  maxy = std::max(v1->p.y, std::max(v->p.y, v3->p.y));
+
+  // Every point in the bounding box of the triangle has a Morton code
+  // between those of its lower left and upper right corners.
+  corner.x = minx;
+  corner.y = miny;
+  zmin = ZOrder(index, corner);
+  corner.x = maxx;
+  corner.y = maxy;
+  zmax = ZOrder(index, corner);
+
+  v->isEar = true;
+  entry = (long)(std::lower_bound(index->entries, index->entries + index->numentries, (uint64_t)zmin << 32) -
+          index->entries);
+  for (entry = NextReflexEntry(index, entry); entry < index->numentries; entry = NextReflexEntry(index, entry)) {
+    z = (uint32_t)(index->entries[entry] >> 32);
+    if (z > zmax) {
+      break;
+    }
+    p = &(vertices[index->entries[entry] & 0xFFFFFFFF].p);
+    if ((p->x < minx) || (p->x > maxx) || (p->y < miny) || (p->y > maxy)) {
+      // Skip the run of codes outside the box.
+      bigmin = ZOrderBigMin(z, zmin, zmax);
+      if (bigmin > z) {
+        entry = (long)(std::lower_bound(index->entries + entry, index->entries + index->numentries,
+                                        (uint64_t)bigmin << 32) -
+                index->entries);
+      } else {
+        entry++;
+      }
+      continue;
+    }
+    entry++;
+    if ((p->x == v->p.x) && (p->y == v->p.y)) {
+      continue;
+    }
+    if ((p->x == v1->p.x) && (p->y == v1->p.y)) {
+      continue;
+    }
+    if ((p->x == v3->p.x) && (p->y == v3->p.y)) {
+      continue;
+    }
+    if (IsInside(v1->p, v->p, v3->p, *p)) {
+      v->isEar = false;
+      break;
+    }
+  }
+}
+
+// Triangulation by ear removal, testing ears only against reflex vertices.
+int TPPLPartition::Triangulate_ECZ(TPPLPoly *poly, uint32_t *indices, long *numtriangles, bool mostextruded) {
+  *numtriangles = 0;
+  if (!poly->Valid()) {
+    return 0;
+  }
+  return TriangulateEarsZ(poly->GetPoints(), poly->GetNumPoints(), indices, numtriangles, mostextruded);
+}
+
+int TPPLPartition::TriangulateEarsZ(const TPPLPoint *points, long numvertices, uint32_t *indices, long *numtriangles,
+        bool mostextruded) {
+  long numactive;
+  PartitionVertex *vertices = NULL;
+  PartitionVertex *ear = NULL, *current = NULL, *stop = NULL;
+  PartitionVertex *v = NULL, *v1 = NULL, *v2 = NULL;
+  ReflexIndex index;
+  EarHeap earheap;
+  signed char *orientations = NULL;
+  tppl_coord minx, miny, maxx, maxy;
+  long i, j, k, l;
+
+  if (numvertices == 3) {
+    AddTriangle(indices, numtriangles, 0, 1, 2);
+    return 1;
+  }
+
+  vertices = workspace.Get(workspace.partitionvertices, numvertices);
+  minx = maxx = points[0].x;
+  miny = maxy = points[0].y;
   for (i = 0; i < numvertices; i++) {
     vertices[i].isActive = true;
-    vertices[i].p = poly->GetPoint(i);
+    vertices[i].p = points[i];
     if (i == (numvertices - 1)) {
       vertices[i].next = &(vertices[0]);
     } else {
@@ -462,75 +2212,186 @@ int TPPLPartition::Triangulate_EC(TPPLPoly *poly, TPPLPolyList *triangles) {
     } else {
       vertices[i].previous = &(vertices[i - 1]);
     }
+    minx = std::min(minx, vertices[i].p.x);
+    miny = std::min(miny, vertices[i].p.y);
+    maxx = std::max(maxx, vertices[i].p.x);
+    maxy = std::max(maxy, vertices[i].p.y);
   }
+
+  orientations = workspace.Get(workspace.orientations, numvertices);
+  ClassifyVertices(points, sizeof(TPPLPoint), numvertices, orientations);
+
+  // Build the z-order index of the reflex vertices.
+  index.minx = minx;
+  index.miny = miny;
+  index.scale = std::max((tppl_float)maxx - minx, (tppl_float)maxy - miny);
+  index.scale = (index.scale > 0) ? 65535 / index.scale : 0;
+  index.entries = workspace.Get(workspace.reflexentries, numvertices);
+  index.skip = workspace.Get(workspace.reflexskip, numvertices + 1);
+  index.positions = workspace.Get(workspace.reflexpositions, numvertices);
   for (i = 0; i < numvertices; i++) {
-    UpdateVertex(&vertices[i], vertices, numvertices);
+    index.entries[i] = ((uint64_t)ZOrder(&index, vertices[i].p) << 32) | (uint64_t)i;
+    index.positions[i] = 0;
   }
-
-  for (i = 0; i < numvertices - 3; i++) {
-    earfound = false;
-    // Find the most extruded ear.
-    for (j = 0; j < numvertices; j++) {
-      if (!vertices[j].isActive) {
-        continue;
+  std::sort(index.entries, index.entries + numvertices);
+
+  // Vertices that share their position with another one (as produced by
+  // RemoveHoles) can block an ear without any reflex vertex doing so,
+  // so they are kept in the index for the whole triangulation.
+  for (i = 0; i < numvertices; i = j) {
+    for (j = i + 1; j < numvertices; j++) {
+      if ((index.entries[j] >> 32) != (index.entries[i] >> 32)) {
+        break;
       }
-      if (!vertices[j].isEar) {
-        continue;
+    }
+    for (k = i; k < j; k++) {
+      for (l = k + 1; l < j; l++) {
+        v1 = &(vertices[index.entries[k] & 0xFFFFFFFF]);
+        v2 = &(vertices[index.entries[l] & 0xFFFFFFFF]);
+        if ((v1->p.x == v2->p.x) && (v1->p.y == v2->p.y)) {
+          index.positions[v1 - vertices] = -1;
+          index.positions[v2 - vertices] = -1;
+        }
       }
-      if (!earfound) {
-        earfound = true;
-        ear = &(vertices[j]);
-      } else {
-        if (vertices[j].angle > ear->angle) {
-          ear = &(vertices[j]);
+    }
+  }
+
+  index.numentries = 0;
+  for (i = 0; i < numvertices; i++) {
+    v = &(vertices[index.entries[i] & 0xFFFFFFFF]);
+    if (index.positions[v - vertices] < 0) {
+      index.skip[index.numentries] = index.numentries;
+      index.entries[index.numentries++] = index.entries[i];
+    } else if (orientations[v - vertices] <= 0) {
+      index.positions[v - vertices] = index.numentries;
+      index.skip[index.numentries] = index.numentries;
+      index.entries[index.numentries++] = index.entries[i];
+    } else {
+      index.positions[v - vertices] = -1;
+    }
+  }
+  index.skip[index.numentries] = index.numentries;
+
+  if (mostextruded) {
+    earheap.heap = workspace.Get(workspace.earheap, numvertices);
+    earheap.positions = workspace.Get(workspace.earheappositions, numvertices);
+    earheap.angles = workspace.Get(workspace.earheapangles, numvertices);
+    earheap.size = 0;
+  }
+  for (i = 0; i < numvertices; i++) {
+    UpdateVertexZ(&vertices[i], vertices, &index, mostextruded);
+    if (mostextruded) {
+      earheap.positions[i] = -1;
+      UpdateEarHeap(&earheap, i, vertices[i].isEar, vertices[i].angle);
+    }
+  }
+
+  // Unless the most extruded ear is wanted, the polygon is walked along,
+  // clipping ears as they are found, until a full lap finds none.
+  current = stop = &(vertices[0]);
+
+  for (numactive = numvertices; numactive > 3; numactive--) {
+    ear = NULL;
+    if (mostextruded) {
+      if (earheap.size > 0) {
+        ear = &(vertices[earheap.heap[0]]);
+      }
+    } else {
+      while (!current->isEar) {
+        current = current->next;
+        if (current == stop) {
+          break;
         }
       }
+      if (current->isEar) {
+        ear = current;
+      }
     }
-    if (!earfound) {
-      delete[] vertices;
+    if (ear == NULL) {
       return 0;
     }
 
-    triangle.Triangle(ear->previous->p, ear->p, ear->next->p);
-    triangles->push_back(triangle);
+    AddTriangle(indices, numtriangles, ear->previous - vertices, ear - vertices, ear->next - vertices);
 
     ear->isActive = false;
     ear->previous->next = ear->next;
     ear->next->previous = ear->previous;
 
-    if (i == numvertices - 4) {
+    if (numactive == 4) {
       break;
     }
 
-    UpdateVertex(ear->previous, vertices, numvertices);
-    UpdateVertex(ear->next, vertices, numvertices);
+    if (mostextruded) {
+      UpdateEarHeap(&earheap, ear - vertices, false, 0);
+    }
+    UpdateVertexZ(ear->previous, vertices, &index, mostextruded);
+    if (mostextruded) {
+      UpdateEarHeap(&earheap, ear->previous - vertices, ear->previous->isEar, ear->previous->angle);
+    }
+    UpdateVertexZ(ear->next, vertices, &index, mostextruded);
+    if (mostextruded) {
+      UpdateEarHeap(&earheap, ear->next - vertices, ear->next->isEar, ear->next->angle);
+    }
+
+    // Skipping a vertex after each clip keeps the triangles from fanning out.
+    current = stop = ear->next->next;
+  }
+  for (i = 0; i < numvertices; i++) {
+    if (vertices[i].isActive) {
+      AddTriangle(indices, numtriangles, vertices[i].previous - vertices, i, vertices[i].next - vertices);
+      break;
+    }
+  }
+
+  return 1;
+}
+
+int TPPLPartition::Triangulate_ECZ(TPPLPoly *poly, TPPLPolyList *triangles, bool mostextruded) {
+  if (!poly->Valid()) {
+    return 0;
   }
-  for (i = 0; i < numvertices; i++) {
-    if (vertices[i].isActive) {
-      triangle.Triangle(vertices[i].previous->p, vertices[i].p, vertices[i].next->p);
-      triangles->push_back(triangle);
-      break;
-    }
+  if (poly->GetNumPoints() == 3) {
+    triangles->push_back(*poly);
+    return 1;
   }
 
-  delete[] vertices;
+  uint32_t *indices = workspace.Get(workspace.indices, 3 * (poly->GetNumPoints() - 2));
+  long numtriangles;
+  int ret;
 
-  return 1;
+  ret = Triangulate_ECZ(poly, indices, &numtriangles, mostextruded);
+  AddTriangles(poly->GetPoints(), indices, numtriangles, triangles);
+
+  return ret;
 }
 
-int TPPLPartition::Triangulate_EC(TPPLPolyList *inpolys, TPPLPolyList *triangles) {
-  TPPLPolyList outpolys;
-  TPPLPolyList::iterator iter;
+uint64_t TPPLPartition::HashEdge(const TPPLPoint &p1, const TPPLPoint &p2) {
+  tppl_coord coordinates[4];
+  uint64_t hash, word;
+  long i;
 
-  if (!RemoveHoles(inpolys, &outpolys)) {
-    return 0;
+  // Adding 0 turns -0 into 0, they compare equal and have to hash the same.
+  coordinates[0] = p1.x + 0;
+  coordinates[1] = p1.y + 0;
+  coordinates[2] = p2.x + 0;
+  coordinates[3] = p2.y + 0;
+
+  hash = 0;
+  for (i = 0; i < 4; i++) {
+    word = 0;
+    memcpy(&word, &(coordinates[i]), sizeof(tppl_coord));
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+    hash ^= hash >> 29;
   }
-  for (iter = outpolys.begin(); iter != outpolys.end(); iter++) {
-    if (!Triangulate_EC(&(*iter), triangles)) {
-      return 0;
-    }
+  return hash;
+}
+
+long TPPLPartition::FindFace(long *faceparents, long face) {
+  while (faceparents[face] != face) {
+    faceparents[face] = faceparents[faceparents[face]];
+    face = faceparents[face];
   }
-  return 1;
+  return face;
 }
 
 int TPPLPartition::ConvexPartition_HM(TPPLPoly *poly, TPPLPolyList *parts) {
@@ -538,29 +2399,24 @@ int TPPLPartition::ConvexPartition_HM(TPPLPoly *poly, TPPLPolyList *parts) {
     return 0;
   }
 
-  TPPLPolyList triangles;
-  TPPLPolyList::iterator iter1, iter2;
-  TPPLPoly *poly1 = NULL, *poly2 = NULL;
+  HalfEdge *halfedges = NULL;
+  long *table = NULL, *faceparents = NULL, *facestarts = NULL, *facesizes = NULL;
+  uint32_t *indices = NULL;
+  long numtriangles, numhalfedges, tablemask, position;
+  long face1, face2, start, e, h, twin, j, k;
+  long i11;
+  signed char *orientations = NULL;
   TPPLPoly newpoly;
   TPPLPoint d1, d2, p1, p2, p3;
-  long i11, i12, i21, i22, i13, i23, j, k;
-  bool isdiagonal;
   long numreflex;
+  bool ambiguous;
 
   // Check if the poly is already convex.
+  orientations = workspace.Get(workspace.orientations, poly->GetNumPoints());
+  ClassifyVertices(poly->GetPoints(), sizeof(TPPLPoint), poly->GetNumPoints(), orientations);
   numreflex = 0;
   for (i11 = 0; i11 < poly->GetNumPoints(); i11++) {
-    if (i11 == 0) {
-      i12 = poly->GetNumPoints() - 1;
-    } else {
-      i12 = i11 - 1;
-    }
-    if (i11 == (poly->GetNumPoints() - 1)) {
-      i13 = 0;
-    } else {
-      i13 = i11 + 1;
-    }
-    if (IsReflex(poly->GetPoint(i12), poly->GetPoint(i11), poly->GetPoint(i13))) {
+    if (orientations[i11] < 0) {
       numreflex = 1;
       break;
     }
@@ -570,289 +2426,683 @@ int TPPLPartition::ConvexPartition_HM(TPPLPoly *poly, TPPLPolyList *parts) {
     return 1;
   }
 
-  if (!Triangulate_EC(poly, &triangles)) {
+  indices = workspace.Get(workspace.indices, 3 * (poly->GetNumPoints() - 2));
+  if (!Triangulate_EC(poly, indices, &numtriangles)) {
     return 0;
   }
 
-  for (iter1 = triangles.begin(); iter1 != triangles.end(); iter1++) {
-    poly1 = &(*iter1);
-    for (i11 = 0; i11 < poly1->GetNumPoints(); i11++) {
-      d1 = poly1->GetPoint(i11);
-      i12 = (i11 + 1) % (poly1->GetNumPoints());
-      d2 = poly1->GetPoint(i12);
+  // Each triangle starts out as a face of three half-edges.
+  numhalfedges = 3 * numtriangles;
+  halfedges = workspace.Get(workspace.halfedges, numhalfedges);
+  faceparents = workspace.Get(workspace.faceparents, numtriangles);
+  facestarts = workspace.Get(workspace.facestarts, numtriangles);
+  facesizes = workspace.Get(workspace.facesizes, numtriangles);
+  for (face1 = 0; face1 < numtriangles; face1++) {
+    for (j = 0; j < 3; j++) {
+      e = 3 * face1 + j;
+      halfedges[e].origin = indices[e];
+      halfedges[e].previous = 3 * face1 + (j + 2) % 3;
+      halfedges[e].next = 3 * face1 + (j + 1) % 3;
+      halfedges[e].face = face1;
+      halfedges[e].twin = -1;
+      halfedges[e].nextequal = -1;
+    }
+    faceparents[face1] = face1;
+    facestarts[face1] = 3 * face1;
+    facesizes[face1] = 3;
+  }
+
+  // Chain the half-edges between the same two positions in the same
+  // direction. table holds the first half-edge of each chain.
+  for (tablemask = 1; tablemask < 2 * numhalfedges; tablemask *= 2) {
+  }
+  table = workspace.Get(workspace.halfedgetable, tablemask);
+  tablemask--;
+  for (position = 0; position <= tablemask; position++) {
+    table[position] = -1;
+  }
+  for (e = numhalfedges - 1; e >= 0; e--) {
+    d1 = poly->GetPoint(halfedges[e].origin);
+    d2 = poly->GetPoint(halfedges[halfedges[e].next].origin);
+    position = (long)(HashEdge(d1, d2) & tablemask);
+    while (table[position] != -1) {
+      h = table[position];
+      if ((poly->GetPoint(halfedges[h].origin) == d1) && (poly->GetPoint(halfedges[halfedges[h].next].origin) == d2)) {
+        break;
+      }
+      position = (position + 1) & tablemask;
+    }
+    halfedges[e].nextequal = table[position];
+    table[position] = e;
+  }
+  for (e = 0; e < numhalfedges; e++) {
+    d1 = poly->GetPoint(halfedges[e].origin);
+    d2 = poly->GetPoint(halfedges[halfedges[e].next].origin);
+    position = (long)(HashEdge(d2, d1) & tablemask);
+    while (table[position] != -1) {
+      h = table[position];
+      if ((poly->GetPoint(halfedges[h].origin) == d2) && (poly->GetPoint(halfedges[halfedges[h].next].origin) == d1)) {
+        halfedges[e].twin = h;
+        break;
+      }
+      position = (position + 1) & tablemask;
+    }
+  }
 
-      isdiagonal = false;
-      for (iter2 = iter1; iter2 != triangles.end(); iter2++) {
-        if (iter1 == iter2) {
+  // Go through the faces in order, and around each one remove every
+  // diagonal to a later face that leaves both of its ends convex. After
+  // a removal the walk starts over from the end of the removed diagonal.
+  for (face1 = 0; face1 < numtriangles; face1++) {
+    if (faceparents[face1] != face1) {
+      continue;
+    }
+    start = facestarts[face1];
+    e = start;
+    while (1) {
+      // The earliest later face holding the twin of e, and the first such
+      // twin in it.
+      twin = -1;
+      face2 = numtriangles;
+      ambiguous = false;
+      for (h = halfedges[e].twin; h != -1; h = halfedges[h].nextequal) {
+        if (halfedges[h].next == -1) {
           continue;
         }
-        poly2 = &(*iter2);
-
-        for (i21 = 0; i21 < poly2->GetNumPoints(); i21++) {
-          if ((d2.x != poly2->GetPoint(i21).x) || (d2.y != poly2->GetPoint(i21).y)) {
-            continue;
-          }
-          i22 = (i21 + 1) % (poly2->GetNumPoints());
-          if ((d1.x != poly2->GetPoint(i22).x) || (d1.y != poly2->GetPoint(i22).y)) {
-            continue;
-          }
-          isdiagonal = true;
-          break;
+        k = FindFace(faceparents, halfedges[h].face);
+        if ((k <= face1) || (k > face2)) {
+          continue;
         }
-        if (isdiagonal) {
-          break;
+        ambiguous = (k == face2);
+        if (k < face2) {
+          face2 = k;
+          twin = h;
         }
       }
-
-      if (!isdiagonal) {
-        continue;
+      if (ambiguous) {
+        d1 = poly->GetPoint(halfedges[e].origin);
+        d2 = poly->GetPoint(halfedges[halfedges[e].next].origin);
+        twin = facestarts[face2];
+        while ((poly->GetPoint(halfedges[twin].origin) != d2) || (poly->GetPoint(halfedges[halfedges[twin].next].origin) != d1)) {
+          twin = halfedges[twin].next;
+        }
       }
 
-      p2 = poly1->GetPoint(i11);
-      if (i11 == 0) {
-        i13 = poly1->GetNumPoints() - 1;
-      } else {
-        i13 = i11 - 1;
+      if (twin != -1) {
+        p1 = poly->GetPoint(halfedges[halfedges[e].previous].origin);
+        p2 = poly->GetPoint(halfedges[e].origin);
+        p3 = poly->GetPoint(halfedges[halfedges[halfedges[twin].next].next].origin);
+        if (IsConvex(p1, p2, p3)) {
+          p1 = poly->GetPoint(halfedges[halfedges[twin].previous].origin);
+          p2 = poly->GetPoint(halfedges[twin].origin);
+          p3 = poly->GetPoint(halfedges[halfedges[halfedges[e].next].next].origin);
+          if (IsConvex(p1, p2, p3)) {
+            // Join the faces, the merged face starts at the end of e.
+            start = halfedges[e].next;
+            halfedges[halfedges[e].previous].next = halfedges[twin].next;
+            halfedges[halfedges[twin].next].previous = halfedges[e].previous;
+            halfedges[halfedges[twin].previous].next = halfedges[e].next;
+            halfedges[halfedges[e].next].previous = halfedges[twin].previous;
+            halfedges[e].next = -1;
+            halfedges[twin].next = -1;
+
+            faceparents[face2] = face1;
+            facestarts[face1] = start;
+            facesizes[face1] += facesizes[face2] - 2;
+            e = start;
+            continue;
+          }
+        }
       }
-      p1 = poly1->GetPoint(i13);
-      if (i22 == (poly2->GetNumPoints() - 1)) {
-        i23 = 0;
-      } else {
-        i23 = i22 + 1;
+      e = halfedges[e].next;
+      if (e == start) {
+        break;
       }
-      p3 = poly2->GetPoint(i23);
+    }
+  }
 
-      if (!IsConvex(p1, p2, p3)) {
-        continue;
-      }
+  for (face1 = 0; face1 < numtriangles; face1++) {
+    if (faceparents[face1] != face1) {
+      continue;
+    }
+    newpoly.Init(facesizes[face1]);
+    e = facestarts[face1];
+    for (k = 0; k < facesizes[face1]; k++) {
+      newpoly[k] = poly->GetPoint(halfedges[e].origin);
+      e = halfedges[e].next;
+    }
+    parts->push_back(std::move(newpoly));
+  }
 
-      p2 = poly1->GetPoint(i12);
-      if (i12 == (poly1->GetNumPoints() - 1)) {
-        i13 = 0;
-      } else {
-        i13 = i12 + 1;
+  return 1;
+}
+
+int TPPLPartition::ConvexPartition_HM(TPPLPolyList *inpolys, TPPLPolyList *parts) {
+  TPPLPolyList outpolys;
+  TPPLPolyList::iterator iter;
+
+  if (!RemoveHoles_Grid(inpolys, &outpolys)) {
+    return 0;
+  }
+  for (iter = outpolys.begin(); iter != outpolys.end(); iter++) {
+    if (!ConvexPartition_HM(&(*iter), parts)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int TPPLPartition::ConvexPartition_HM(TPPLPolyList *groups, long numgroups, TPPLPolyList *parts, int *statuses) {
+  return RunBatch(BATCH_CONVEX_PARTITION_HM, groups, numgroups, parts, statuses);
+}
+
+void TPPLPartition::ComputeVisibilityRow(TPPLPoly *poly, TPPLVisibility *visibility, long i, VisibilityScratch *scratch) {
+  // Directions within this many radians of an edge's angular range are
+  // tested against it, so that rounding can't let an edge slip through.
+  const double epsilon = 1e-9;
+  const double pi = 3.14159265358979323846;
+  long n, j, k, numevents, numactive, first, last, position, steps;
+  VisibilityQuery *queries = scratch->queries;
+  long *ranks = scratch->ranks;
+  TPPLPoint p1, p2, p3, p4;
+  double d3x, d3y, d4x, d4y, cross, difference;
+
+  n = poly->GetNumPoints();
+  p1 = poly->GetPoint(i);
+
+  // All vertices, sorted by angle around p1.
+  for (j = 0; j < n; j++) {
+    queries[j].angle = atan2((double)poly->GetPoint(j).y - p1.y, (double)poly->GetPoint(j).x - p1.x);
+    queries[j].vertex = j;
+  }
+  std::sort(queries, queries + n);
+  for (j = 0; j < n; j++) {
+    ranks[queries[j].vertex] = j;
+  }
+
+  // A segment from p1 can only cross an edge if its direction lies within
+  // the angle the edge spans as seen from p1, which is a cyclic run of the
+  // sorted vertices between the edge's endpoints. Each run adds the edge
+  // to the active edges at its first vertex and removes it after its last.
+  // Edges (nearly) in line with p1 stay active throughout.
+  numevents = 0;
+  numactive = 0;
+  for (k = 0; k < n; k++) {
+    scratch->activepositions[k] = -1;
+    p3 = poly->GetPoint(k);
+    p4 = poly->GetPoint((k + 1) % n);
+    if (((p3.x == p1.x) && (p3.y == p1.y)) || ((p4.x == p1.x) && (p4.y == p1.y))) {
+      // Edges touching p1 never block it, see Intersects.
+      continue;
+    }
+    d3x = (double)p3.x - p1.x;
+    d3y = (double)p3.y - p1.y;
+    d4x = (double)p4.x - p1.x;
+    d4y = (double)p4.y - p1.y;
+    cross = d3x * d4y - d3y * d4x;
+    if (fabs(cross) <= epsilon * sqrt((d3x * d3x + d3y * d3y) * (d4x * d4x + d4y * d4y))) {
+      scratch->activepositions[k] = numactive;
+      scratch->activeedges[numactive++] = k;
+      continue;
+    }
+    if (cross > 0) {
+      first = ranks[k];
+      last = ranks[(k + 1) % n];
+    } else {
+      first = ranks[(k + 1) % n];
+      last = ranks[k];
+    }
+
+    // Widen the run by the vertices within epsilon of either end.
+    for (steps = 0; steps < n; steps++) {
+      j = (first + n - 1) % n;
+      difference = queries[first].angle - queries[j].angle;
+      if (difference < 0) {
+        difference += 2 * pi;
       }
-      p3 = poly1->GetPoint(i13);
-      if (i21 == 0) {
-        i23 = poly2->GetNumPoints() - 1;
-      } else {
-        i23 = i21 - 1;
+      if ((j == last) || (difference > epsilon)) {
+        break;
       }
-      p1 = poly2->GetPoint(i23);
-
-      if (!IsConvex(p1, p2, p3)) {
-        continue;
+      first = j;
+    }
+    for (; steps < n; steps++) {
+      j = (last + 1) % n;
+      difference = queries[j].angle - queries[last].angle;
+      if (difference < 0) {
+        difference += 2 * pi;
       }
-
-      newpoly.Init(poly1->GetNumPoints() + poly2->GetNumPoints() - 2);
-      k = 0;
-      for (j = i12; j != i11; j = (j + 1) % (poly1->GetNumPoints())) {
-        newpoly[k] = poly1->GetPoint(j);
-        k++;
+      if ((j == first) || (difference > epsilon)) {
+        break;
       }
-      for (j = i22; j != i21; j = (j + 1) % (poly2->GetNumPoints())) {
-        newpoly[k] = poly2->GetPoint(j);
-        k++;
+      last = j;
+    }
+
+    if (((last + 1) % n) == first) {
+      scratch->activepositions[k] = numactive;
+      scratch->activeedges[numactive++] = k;
+    } else if (first <= last) {
+      scratch->events[numevents++] = ((uint64_t)first << 32) | ((uint64_t)k << 1);
+      scratch->events[numevents++] = ((uint64_t)(last + 1) << 32) | ((uint64_t)k << 1) | 1;
+    } else {
+      scratch->events[numevents++] = ((uint64_t)first << 32) | ((uint64_t)k << 1);
+      scratch->events[numevents++] = ((uint64_t)n << 32) | ((uint64_t)k << 1) | 1;
+      scratch->events[numevents++] = ((uint64_t)0 << 32) | ((uint64_t)k << 1);
+      scratch->events[numevents++] = ((uint64_t)(last + 1) << 32) | ((uint64_t)k << 1) | 1;
+    }
+  }
+
+  // Bucket the events by position, afterwards eventstarts[j] is the end of
+  // the events at position j.
+  for (j = 0; j <= (n + 1); j++) {
+    scratch->eventstarts[j] = 0;
+  }
+  for (k = 0; k < numevents; k++) {
+    scratch->eventstarts[(scratch->events[k] >> 32) + 1]++;
+  }
+  for (j = 0; j <= n; j++) {
+    scratch->eventstarts[j + 1] += scratch->eventstarts[j];
+  }
+  for (k = 0; k < numevents; k++) {
+    position = (long)(scratch->events[k] >> 32);
+    scratch->sortedevents[scratch->eventstarts[position]++] = (long)(scratch->events[k] & 0xFFFFFFFF);
+  }
+
+  first = 0;
+  for (j = 0; j < n; j++) {
+    for (; first < scratch->eventstarts[j]; first++) {
+      k = scratch->sortedevents[first] >> 1;
+      if (scratch->sortedevents[first] & 1) {
+        position = scratch->activepositions[k];
+        scratch->activeedges[position] = scratch->activeedges[--numactive];
+        scratch->activepositions[scratch->activeedges[position]] = position;
+        scratch->activepositions[k] = -1;
+      } else {
+        scratch->activepositions[k] = numactive;
+        scratch->activeedges[numactive++] = k;
       }
+    }
 
-      triangles.erase(iter2);
-      *iter1 = newpoly;
-      poly1 = &(*iter1);
-      i11 = -1;
+    k = queries[j].vertex;
+    if (k <= i) {
+      continue;
+    }
+    if ((k == (i + 1)) || ((i == 0) && (k == (n - 1)))) {
+      visibility->SetVisible(i, k);
+      continue;
+    }
+    p2 = poly->GetPoint(k);
 
+    // Visibility check.
+    if (!InCone(poly->GetPoint((i + n - 1) % n), p1, poly->GetPoint((i + 1) % n), p2)) {
       continue;
     }
+    if (!InCone(poly->GetPoint((k + n - 1) % n), p2, poly->GetPoint((k + 1) % n), p1)) {
+      continue;
+    }
+    for (position = 0; position < numactive; position++) {
+      p3 = poly->GetPoint(scratch->activeedges[position]);
+      p4 = poly->GetPoint((scratch->activeedges[position] + 1) % n);
+      if (Intersects(p1, p2, p3, p4)) {
+        break;
+      }
+    }
+    if (position == numactive) {
+      visibility->SetVisible(i, k);
+    }
+  }
+}
+
+int TPPLPartition::ComputeVisibility(TPPLPoly *poly, TPPLVisibility *visibility) {
+  if (!poly->Valid()) {
+    return 0;
   }
 
-  for (iter1 = triangles.begin(); iter1 != triangles.end(); iter1++) {
-    parts->push_back(*iter1);
+  long n, numthreads, i;
+  VisibilityScratch *scratch = NULL;
+
+  struct Sweep {
+    TPPLPartition *partition;
+    TPPLPoly *poly;
+    TPPLVisibility *visibility;
+    VisibilityScratch *scratch;
+
+    void operator()(long begin, long end, long thread) {
+      long i;
+      for (i = begin; i < end; i++) {
+        partition->ComputeVisibilityRow(poly, visibility, i, &scratch[thread]);
+      }
+    }
+  } sweep;
+
+  n = poly->GetNumPoints();
+  numthreads = threadpool.GetNumThreads();
+  visibility->Init(n);
+
+  scratch = workspace.Get(workspace.visibilityscratch, numthreads);
+  for (i = 0; i < numthreads; i++) {
+    scratch[i].queries = workspace.Get(scratch[i].querybuffer, n);
+    scratch[i].ranks = workspace.Get(scratch[i].rankbuffer, n);
+    scratch[i].events = workspace.Get(scratch[i].eventbuffer, 4 * n);
+    scratch[i].sortedevents = workspace.Get(scratch[i].sortedeventbuffer, 4 * n);
+    scratch[i].eventstarts = workspace.Get(scratch[i].eventstartbuffer, n + 2);
+    scratch[i].activeedges = workspace.Get(scratch[i].activeedgebuffer, n);
+    scratch[i].activepositions = workspace.Get(scratch[i].activepositionbuffer, n);
   }
 
+  sweep.partition = this;
+  sweep.poly = poly;
+  sweep.visibility = visibility;
+  sweep.scratch = scratch;
+
+  // Every row starts on a new word, so threads never write the same word.
+  threadpool.Run(n - 1, 1, sweep);
+
   return 1;
 }
 
-int TPPLPartition::ConvexPartition_HM(TPPLPolyList *inpolys, TPPLPolyList *parts) {
-  TPPLPolyList outpolys;
-  TPPLPolyList::iterator iter;
+// Picks the vertex k minimizing the weight of the sub-polygon from i to j,
+// given the weights of all shorter diagonals.
+bool TPPLPartition::UpdateOPTState(TPPLPoly *poly, OPTTables *tables, long i, long j) {
+  long n, k, rowstart, state, ikstate, kjstate;
+  long bestvertex;
+  tppl_float weight, minweight, d1, d2;
 
-  if (!RemoveHoles(inpolys, &outpolys)) {
-    return 0;
+  n = tables->n;
+  rowstart = i * (2 * n - i - 1) / 2 - i - 1;
+  state = rowstart + j;
+  if (!tables->visibility->IsVisible(i, j)) {
+    return true;
   }
-  for (iter = outpolys.begin(); iter != outpolys.end(); iter++) {
-    if (!ConvexPartition_HM(&(*iter), parts)) {
-      return 0;
+
+  bestvertex = -1;
+  minweight = 0;
+  for (k = (i + 1); k < j; k++) {
+    if (!tables->visibility->IsVisible(i, k)) {
+      continue;
+    }
+    if (!tables->visibility->IsVisible(k, j)) {
+      continue;
+    }
+    ikstate = rowstart + k;
+    kjstate = k * (2 * n - k - 1) / 2 - k - 1 + j;
+
+    if (k <= (i + 1)) {
+      d1 = 0;
+    } else {
+      d1 = Distance(poly->GetPoint(i), poly->GetPoint(k));
+    }
+    if (j <= (k + 1)) {
+      d2 = 0;
+    } else {
+      d2 = Distance(poly->GetPoint(k), poly->GetPoint(j));
+    }
+
+    weight = tables->weights[ikstate] + tables->weights[kjstate] + d1 + d2;
+
+    if ((bestvertex == -1) || (weight < minweight)) {
+      bestvertex = k;
+      minweight = weight;
     }
   }
-  return 1;
+  if (bestvertex == -1) {
+    return false;
+  }
+
+  tables->bestvertices[state] = (int32_t)bestvertex;
+  tables->weights[state] = minweight;
+  return true;
 }
 
 // Minimum-weight polygon triangulation by dynamic programming.
 // Time complexity: O(n^3)
 // Space complexity: O(n^2)
-int TPPLPartition::Triangulate_OPT(TPPLPoly *poly, TPPLPolyList *triangles) {
+int TPPLPartition::Triangulate_OPT(TPPLPoly *poly, uint32_t *indices, long *numtriangles) {
+  *numtriangles = 0;
+  if (!ComputeVisibility(poly, &workspace.visibility)) {
+    return 0;
+  }
+  return Triangulate_OPT(poly, &workspace.visibility, indices, numtriangles);
+}
+
+int TPPLPartition::Triangulate_OPT(TPPLPoly *poly, const TPPLVisibility *visibility, uint32_t *indices, long *numtriangles) {
+  *numtriangles = 0;
   if (!poly->Valid()) {
     return 0;
   }
+  if (visibility->GetNumPoints() != poly->GetNumPoints()) {
+    return 0;
+  }
 
-  long i, j, k, gap, n;
-  DPState **dpstates = NULL;
-  TPPLPoint p1, p2, p3, p4;
+  long i, j, k, n, gap;
+  long numstates, rowstart, krowstart, state;
+  tppl_float *weights = NULL;
+  int32_t *bestvertices = NULL;
   long bestvertex;
-  tppl_float weight, minweight, d1, d2;
+  tppl_float weight, ikweight, d1, d2;
+  Diagonal *diagonals = NULL;
   Diagonal diagonal, newdiagonal;
-  DiagonalList diagonals;
-  TPPLPoly triangle;
+  long first, last;
   int ret = 1;
 
   n = poly->GetNumPoints();
-  dpstates = new DPState *[n];
-  for (i = 1; i < n; i++) {
-    dpstates[i] = new DPState[i];
+
+  // The states of the diagonals (i, j), j > i, are stored row by row in
+  // one upper triangular array, the state of (i, j) being at
+  // i * (2 * n - i - 1) / 2 - i - 1 + j.
+  numstates = n * (n - 1) / 2;
+  weights = workspace.Get(workspace.optweights, numstates);
+  bestvertices = workspace.Get(workspace.optbestvertices, numstates);
+
+  // Initialize states.
+  for (state = 0; state < numstates; state++) {
+    weights[state] = 0;
+    bestvertices[state] = -1;
   }
 
-  // Initialize states and visibility.
-  for (i = 0; i < (n - 1); i++) {
-    p1 = poly->GetPoint(i);
-    for (j = i + 1; j < n; j++) {
-      dpstates[j][i].visible = true;
-      dpstates[j][i].weight = 0;
-      dpstates[j][i].bestvertex = -1;
-      if (j != (i + 1)) {
-        p2 = poly->GetPoint(j);
-
-        // Visibility check.
-        if (i == 0) {
-          p3 = poly->GetPoint(n - 1);
-        } else {
-          p3 = poly->GetPoint(i - 1);
-        }
-        if (i == (n - 1)) {
-          p4 = poly->GetPoint(0);
-        } else {
-          p4 = poly->GetPoint(i + 1);
+  if (threadpool.GetNumThreads() > 1) {
+    // All diagonals spanning the same number of edges only depend on
+    // shorter ones, so each of these wavefronts is split among the threads.
+    struct Wavefront {
+      TPPLPartition *partition;
+      TPPLPoly *poly;
+      OPTTables tables;
+      long gap;
+      std::atomic<bool> failed;
+
+      void operator()(long begin, long end, long) {
+        long i;
+        for (i = begin; i < end; i++) {
+          if (!partition->UpdateOPTState(poly, &tables, i, i + gap)) {
+            failed.store(true, std::memory_order_relaxed);
+          }
         }
-        if (!InCone(p3, p1, p4, p2)) {
-          dpstates[j][i].visible = false;
+      }
+    } wavefront;
+
+    wavefront.partition = this;
+    wavefront.poly = poly;
+    wavefront.tables.n = n;
+    wavefront.tables.weights = weights;
+    wavefront.tables.bestvertices = bestvertices;
+    wavefront.tables.visibility = visibility;
+    wavefront.failed.store(false);
+    for (gap = 2; gap < n; gap++) {
+      wavefront.gap = gap;
+      // Chunks of roughly constant work.
+      threadpool.Run(n - gap, 1 + 4096 / gap, wavefront);
+      if (wavefront.failed.load()) {
+        return 0;
+      }
+    }
+  } else {
+    // The rows are filled from the bottom up. Once (i, k) has been relaxed
+    // through every k' < k it is final, and in turn relaxes every (i, j),
+    // j > k, through row k. Both rows are read front to back, and every
+    // (i, j) sees its candidates k in increasing order, as with a loop over
+    // increasing gaps.
+    for (i = n - 3; i >= 0; i--) {
+      rowstart = i * (2 * n - i - 1) / 2 - i - 1;
+      for (k = i + 1; k < (n - 1); k++) {
+        state = rowstart + k;
+        if (!visibility->IsVisible(i, k)) {
           continue;
         }
-
-        if (j == 0) {
-          p3 = poly->GetPoint(n - 1);
-        } else {
-          p3 = poly->GetPoint(j - 1);
+        if ((k > (i + 1)) && (bestvertices[state] == -1)) {
+          return 0;
         }
-        if (j == (n - 1)) {
-          p4 = poly->GetPoint(0);
+
+        if (k <= (i + 1)) {
+          d1 = 0;
         } else {
-          p4 = poly->GetPoint(j + 1);
-        }
-        if (!InCone(p3, p2, p4, p1)) {
-          dpstates[j][i].visible = false;
-          continue;
+          d1 = Distance(poly->GetPoint(i), poly->GetPoint(k));
         }
+        ikweight = weights[state];
+
+        krowstart = k * (2 * n - k - 1) / 2 - k - 1;
+        for (j = k + 1; j < n; j++) {
+          state = rowstart + j;
+          if (!visibility->IsVisible(i, j)) {
+            continue;
+          }
+          if (!visibility->IsVisible(k, j)) {
+            continue;
+          }
 
-        for (k = 0; k < n; k++) {
-          p3 = poly->GetPoint(k);
-          if (k == (n - 1)) {
-            p4 = poly->GetPoint(0);
+          if (j <= (k + 1)) {
+            d2 = 0;
           } else {
-            p4 = poly->GetPoint(k + 1);
+            d2 = Distance(poly->GetPoint(k), poly->GetPoint(j));
           }
-          if (Intersects(p1, p2, p3, p4)) {
-            dpstates[j][i].visible = false;
-            break;
+
+          weight = ikweight + weights[krowstart + j] + d1 + d2;
+
+          if ((bestvertices[state] == -1) || (weight < weights[state])) {
+            bestvertices[state] = (int32_t)k;
+            weights[state] = weight;
           }
         }
       }
+      state = rowstart + n - 1;
+      if (visibility->IsVisible(i, n - 1) && (bestvertices[state] == -1)) {
+        return 0;
+      }
     }
   }
-  dpstates[n - 1][0].visible = true;
-  dpstates[n - 1][0].weight = 0;
-  dpstates[n - 1][0].bestvertex = -1;
 
-  for (gap = 2; gap < n; gap++) {
-    for (i = 0; i < (n - gap); i++) {
-      j = i + gap;
-      if (!dpstates[j][i].visible) {
-        continue;
-      }
-      bestvertex = -1;
-      for (k = (i + 1); k < j; k++) {
-        if (!dpstates[k][i].visible) {
-          continue;
-        }
-        if (!dpstates[j][k].visible) {
-          continue;
-        }
+  // Every diagonal in the queue gives one triangle, so there are at most
+  // n - 2 of them.
+  diagonals = workspace.Get(workspace.diagonals, n);
+  first = 0;
+  last = 0;
+  diagonals[last].index1 = 0;
+  diagonals[last].index2 = n - 1;
+  last++;
+  while (first < last) {
+    diagonal = diagonals[first++];
+    bestvertex = bestvertices[diagonal.index1 * (2 * n - diagonal.index1 - 1) / 2 - diagonal.index1 - 1 + diagonal.index2];
+    if (bestvertex == -1) {
+      ret = 0;
+      break;
+    }
+    AddTriangle(indices, numtriangles, diagonal.index1, bestvertex, diagonal.index2);
+    if (bestvertex > (diagonal.index1 + 1)) {
+      newdiagonal.index1 = diagonal.index1;
+      newdiagonal.index2 = bestvertex;
+      diagonals[last++] = newdiagonal;
+    }
+    if (diagonal.index2 > (bestvertex + 1)) {
+      newdiagonal.index1 = bestvertex;
+      newdiagonal.index2 = diagonal.index2;
+      diagonals[last++] = newdiagonal;
+    }
+  }
 
-        if (k <= (i + 1)) {
-          d1 = 0;
-        } else {
-          d1 = Distance(poly->GetPoint(i), poly->GetPoint(k));
-        }
-        if (j <= (k + 1)) {
-          d2 = 0;
-        } else {
-          d2 = Distance(poly->GetPoint(k), poly->GetPoint(j));
-        }
+  return ret;
+}
+
+int TPPLPartition::Triangulate_OPT(TPPLPoly *poly, TPPLPolyList *triangles) {
+  if (!ComputeVisibility(poly, &workspace.visibility)) {
+    return 0;
+  }
+  return Triangulate_OPT(poly, &workspace.visibility, triangles);
+}
+
+int TPPLPartition::Triangulate_OPT(TPPLPoly *poly, const TPPLVisibility *visibility, TPPLPolyList *triangles) {
+  if (!poly->Valid()) {
+    return 0;
+  }
+
+  uint32_t *indices = workspace.Get(workspace.indices, 3 * (poly->GetNumPoints() - 2));
+  long numtriangles;
+  int ret;
 
-        weight = dpstates[k][i].weight + dpstates[j][k].weight + d1 + d2;
+  ret = Triangulate_OPT(poly, visibility, indices, &numtriangles);
+  AddTriangles(poly->GetPoints(), indices, numtriangles, triangles);
 
-        if ((bestvertex == -1) || (weight < minweight)) {
-          bestvertex = k;
-          minweight = weight;
-        }
-      }
-      if (bestvertex == -1) {
-        for (i = 1; i < n; i++) {
-          delete[] dpstates[i];
-        }
-        delete[] dpstates;
+  return ret;
+}
 
-        return 0;
-      }
+void TPPLPartition::PushFrontDiagonal(DPState2 *state, DiagonalPool *pool, long index1, long index2) {
+  long node;
 
-      dpstates[j][i].bestvertex = bestvertex;
-      dpstates[j][i].weight = minweight;
-    }
+  if (pool->freelist != -1) {
+    node = pool->freelist;
+    pool->freelist = pool->nodes[node].next;
+  } else {
+    pool->nodes = workspace.Grow(workspace.diagonalnodes, pool->numnodes + 1, pool->numnodes);
+    node = pool->numnodes++;
   }
 
-  newdiagonal.index1 = 0;
-  newdiagonal.index2 = n - 1;
-  diagonals.push_back(newdiagonal);
-  while (!diagonals.empty()) {
-    diagonal = *(diagonals.begin());
-    diagonals.pop_front();
-    bestvertex = dpstates[diagonal.index2][diagonal.index1].bestvertex;
-    if (bestvertex == -1) {
-      ret = 0;
-      break;
-    }
-    triangle.Triangle(poly->GetPoint(diagonal.index1), poly->GetPoint(bestvertex), poly->GetPoint(diagonal.index2));
-    triangles->push_back(triangle);
-    if (bestvertex > (diagonal.index1 + 1)) {
-      newdiagonal.index1 = diagonal.index1;
-      newdiagonal.index2 = bestvertex;
-      diagonals.push_back(newdiagonal);
-    }
-    if (diagonal.index2 > (bestvertex + 1)) {
-      newdiagonal.index1 = bestvertex;
-      newdiagonal.index2 = diagonal.index2;
-      diagonals.push_back(newdiagonal);
-    }
+  pool->nodes[node].index1 = index1;
+  pool->nodes[node].index2 = index2;
+  pool->nodes[node].previous = -1;
+  pool->nodes[node].next = state->front;
+  if (state->front == -1) {
+    state->back = node;
+  } else {
+    pool->nodes[state->front].previous = node;
   }
+  state->front = node;
+}
 
-  for (i = 1; i < n; i++) {
-    delete[] dpstates[i];
+void TPPLPartition::PopFrontDiagonal(DPState2 *state, DiagonalPool *pool) {
+  long node = state->front;
+
+  state->front = pool->nodes[node].next;
+  if (state->front == -1) {
+    state->back = -1;
+  } else {
+    pool->nodes[state->front].previous = -1;
   }
-  delete[] dpstates;
+  pool->nodes[node].next = pool->freelist;
+  pool->freelist = node;
+}
 
-  return ret;
+void TPPLPartition::PopBackDiagonal(DPState2 *state, DiagonalPool *pool) {
+  long node = state->back;
+
+  state->back = pool->nodes[node].previous;
+  if (state->back == -1) {
+    state->front = -1;
+  } else {
+    pool->nodes[state->back].next = -1;
+  }
+  pool->nodes[node].next = pool->freelist;
+  pool->freelist = node;
+}
+
+void TPPLPartition::ClearDiagonals(DPState2 *state, DiagonalPool *pool) {
+  if (state->front == -1) {
+    return;
+  }
+  // The whole list goes onto the free list at once.
+  pool->nodes[state->back].next = pool->freelist;
+  pool->freelist = state->front;
+  state->front = -1;
+  state->back = -1;
 }
 
-void TPPLPartition::UpdateState(long a, long b, long w, long i, long j, DPState2 **dpstates) {
-  Diagonal newdiagonal;
-  DiagonalList *pairs = NULL;
+void TPPLPartition::UpdateState(long a, long b, long w, long i, long j, DPState2 **dpstates, DiagonalPool *pool) {
+  DPState2 *state = NULL;
   long w2;
 
   w2 = dpstates[a][b].weight;
@@ -860,28 +3110,25 @@ void TPPLPartition::UpdateState(long a, long b, long w, long i, long j, DPState2
     return;
   }
 
-  pairs = &(dpstates[a][b].pairs);
-  newdiagonal.index1 = i;
-  newdiagonal.index2 = j;
+  state = &(dpstates[a][b]);
 
   if (w < w2) {
-    pairs->clear();
-    pairs->push_front(newdiagonal);
-    dpstates[a][b].weight = w;
+    ClearDiagonals(state, pool);
+    PushFrontDiagonal(state, pool, i, j);
+    state->weight = w;
   } else {
-    if ((!pairs->empty()) && (i <= pairs->begin()->index1)) {
+    if ((state->front != -1) && (i <= pool->nodes[state->front].index1)) {
       return;
     }
-    while ((!pairs->empty()) && (pairs->begin()->index2 >= j)) {
-      pairs->pop_front();
+    while ((state->front != -1) && (pool->nodes[state->front].index2 >= j)) {
+      PopFrontDiagonal(state, pool);
     }
-    pairs->push_front(newdiagonal);
+    PushFrontDiagonal(state, pool, i, j);
   }
 }
 
-void TPPLPartition::TypeA(long i, long j, long k, PartitionVertex *vertices, DPState2 **dpstates) {
-  DiagonalList *pairs = NULL;
-  DiagonalList::iterator iter, lastiter;
+void TPPLPartition::TypeA(long i, long j, long k, PartitionVertex *vertices, DPState2 **dpstates, DiagonalPool *pool) {
+  long node, lastnode;
   long top;
   long w;
 
@@ -897,33 +3144,31 @@ void TPPLPartition::TypeA(long i, long j, long k, PartitionVertex *vertices, DPS
     w += dpstates[j][k].weight + 1;
   }
   if (j - i > 1) {
-    pairs = &(dpstates[i][j].pairs);
-    iter = pairs->end();
-    lastiter = pairs->end();
-    while (iter != pairs->begin()) {
-      iter--;
-      if (!IsReflex(vertices[iter->index2].p, vertices[j].p, vertices[k].p)) {
-        lastiter = iter;
+    node = dpstates[i][j].back;
+    lastnode = -1;
+    while (node != -1) {
+      if (!IsReflex(vertices[pool->nodes[node].index2].p, vertices[j].p, vertices[k].p)) {
+        lastnode = node;
       } else {
         break;
       }
+      node = pool->nodes[node].previous;
     }
-    if (lastiter == pairs->end()) {
+    if (lastnode == -1) {
       w++;
     } else {
-      if (IsReflex(vertices[k].p, vertices[i].p, vertices[lastiter->index1].p)) {
+      if (IsReflex(vertices[k].p, vertices[i].p, vertices[pool->nodes[lastnode].index1].p)) {
         w++;
       } else {
-        top = lastiter->index1;
+        top = pool->nodes[lastnode].index1;
       }
     }
   }
-  UpdateState(i, k, w, top, j, dpstates);
+  UpdateState(i, k, w, top, j, dpstates, pool);
 }
 
-void TPPLPartition::TypeB(long i, long j, long k, PartitionVertex *vertices, DPState2 **dpstates) {
-  DiagonalList *pairs = NULL;
-  DiagonalList::iterator iter, lastiter;
+void TPPLPartition::TypeB(long i, long j, long k, PartitionVertex *vertices, DPState2 **dpstates, DiagonalPool *pool) {
+  long node, lastnode;
   long top;
   long w;
 
@@ -940,57 +3185,72 @@ void TPPLPartition::TypeB(long i, long j, long k, PartitionVertex *vertices, DPS
     w += dpstates[i][j].weight + 1;
   }
   if (k - j > 1) {
-    pairs = &(dpstates[j][k].pairs);
-
-    iter = pairs->begin();
-    if ((!pairs->empty()) && (!IsReflex(vertices[i].p, vertices[j].p, vertices[iter->index1].p))) {
-      lastiter = iter;
-      while (iter != pairs->end()) {
-        if (!IsReflex(vertices[i].p, vertices[j].p, vertices[iter->index1].p)) {
-          lastiter = iter;
-          iter++;
+    node = dpstates[j][k].front;
+    if ((node != -1) && (!IsReflex(vertices[i].p, vertices[j].p, vertices[pool->nodes[node].index1].p))) {
+      lastnode = node;
+      while (node != -1) {
+        if (!IsReflex(vertices[i].p, vertices[j].p, vertices[pool->nodes[node].index1].p)) {
+          lastnode = node;
+          node = pool->nodes[node].next;
         } else {
           break;
         }
       }
-      if (IsReflex(vertices[lastiter->index2].p, vertices[k].p, vertices[i].p)) {
+      if (IsReflex(vertices[pool->nodes[lastnode].index2].p, vertices[k].p, vertices[i].p)) {
         w++;
       } else {
-        top = lastiter->index2;
+        top = pool->nodes[lastnode].index2;
       }
     } else {
       w++;
     }
   }
-  UpdateState(i, k, w, j, top, dpstates);
+  UpdateState(i, k, w, j, top, dpstates, pool);
 }
 
 int TPPLPartition::ConvexPartition_OPT(TPPLPoly *poly, TPPLPolyList *parts) {
+  if (!ComputeVisibility(poly, &workspace.visibility)) {
+    return 0;
+  }
+  return ConvexPartition_OPT(poly, &workspace.visibility, parts);
+}
+
+int TPPLPartition::ConvexPartition_OPT(TPPLPoly *poly, const TPPLVisibility *visibility, TPPLPolyList *parts) {
   if (!poly->Valid()) {
     return 0;
   }
+  if (visibility->GetNumPoints() != poly->GetNumPoints()) {
+    return 0;
+  }
 
-  TPPLPoint p1, p2, p3, p4;
   PartitionVertex *vertices = NULL;
   DPState2 **dpstates = NULL;
+  signed char *orientations = NULL;
   long i, j, k, n, gap;
-  DiagonalList diagonals, diagonals2;
+  Diagonal *diagonals = NULL, *diagonals2 = NULL;
+  long numdiagonals, first, first2, last2;
   Diagonal diagonal, newdiagonal;
-  DiagonalList *pairs = NULL, *pairs2 = NULL;
-  DiagonalList::iterator iter, iter2;
+  DPState2 *state = NULL, *state2 = NULL;
+  DiagonalNode *node = NULL;
+  DiagonalPool pool;
   int ret;
-  TPPLPoly newpoly;
-  std::vector<long> indices;
-  std::vector<long>::iterator iiter;
+  long *indices = NULL;
+  long numindices;
   bool ijreal, jkreal;
 
   n = poly->GetNumPoints();
-  vertices = new PartitionVertex[n];
+  vertices = workspace.Get(workspace.partitionvertices, n);
 
-  dpstates = new DPState2 *[n];
+  // All states and diagonal nodes live in the workspace, so nothing is
+  // allocated per state and nothing has to be freed at the end.
+  dpstates = workspace.Get(workspace.dpstaterows, n);
+  state = workspace.Get(workspace.dpstates, n * n);
   for (i = 0; i < n; i++) {
-    dpstates[i] = new DPState2[n];
+    dpstates[i] = state + i * n;
   }
+  pool.nodes = workspace.Get(workspace.diagonalnodes, n);
+  pool.numnodes = 0;
+  pool.freelist = -1;
 
   // Initialize vertex information.
   for (i = 0; i < n; i++) {
@@ -1007,55 +3267,30 @@ int TPPLPartition::ConvexPartition_OPT(TPPLPoly *poly, TPPLPolyList *parts) {
       vertices[i].next = &(vertices[i + 1]);
     }
   }
+  orientations = workspace.Get(workspace.orientations, n);
+  ClassifyVertices(poly->GetPoints(), sizeof(TPPLPoint), n, orientations);
   for (i = 1; i < n; i++) {
-    UpdateVertexReflexity(&(vertices[i]));
+    vertices[i].isConvex = (orientations[i] >= 0);
   }
 
   // Initialize states and visibility.
   for (i = 0; i < (n - 1); i++) {
-    p1 = poly->GetPoint(i);
     for (j = i + 1; j < n; j++) {
-      dpstates[i][j].visible = true;
+      dpstates[i][j].visible = visibility->IsVisible(i, j);
+      dpstates[i][j].front = -1;
+      dpstates[i][j].back = -1;
       if (j == i + 1) {
         dpstates[i][j].weight = 0;
       } else {
         dpstates[i][j].weight = 2147483647;
       }
-      if (j != (i + 1)) {
-        p2 = poly->GetPoint(j);
-
-        // Visibility check.
-        if (!InCone(&vertices[i], p2)) {
-          dpstates[i][j].visible = false;
-          continue;
-        }
-        if (!InCone(&vertices[j], p1)) {
-          dpstates[i][j].visible = false;
-          continue;
-        }
-
-        for (k = 0; k < n; k++) {
-          p3 = poly->GetPoint(k);
-          if (k == (n - 1)) {
-            p4 = poly->GetPoint(0);
-          } else {
-            p4 = poly->GetPoint(k + 1);
-          }
-          if (Intersects(p1, p2, p3, p4)) {
-            dpstates[i][j].visible = false;
-            break;
-          }
-        }
-      }
     }
   }
   for (i = 0; i < (n - 2); i++) {
     j = i + 2;
     if (dpstates[i][j].visible) {
       dpstates[i][j].weight = 0;
-      newdiagonal.index1 = i + 1;
-      newdiagonal.index2 = i + 1;
-      dpstates[i][j].pairs.push_back(newdiagonal);
+      PushFrontDiagonal(&(dpstates[i][j]), &pool, i + 1, i + 1);
     }
   }
 
@@ -1071,16 +3306,16 @@ int TPPLPartition::ConvexPartition_OPT(TPPLPoly *poly, TPPLPolyList *parts) {
       if (dpstates[i][k].visible) {
         if (!vertices[k].isConvex) {
           for (j = i + 1; j < k; j++) {
-            TypeA(i, j, k, vertices, dpstates);
+            TypeA(i, j, k, vertices, dpstates, &pool);
           }
         } else {
           for (j = i + 1; j < (k - 1); j++) {
             if (vertices[j].isConvex) {
               continue;
             }
-            TypeA(i, j, k, vertices, dpstates);
+            TypeA(i, j, k, vertices, dpstates, &pool);
           }
-          TypeA(i, k - 1, k, vertices, dpstates);
+          TypeA(i, k - 1, k, vertices, dpstates, &pool);
         }
       }
     }
@@ -1090,52 +3325,53 @@ int TPPLPartition::ConvexPartition_OPT(TPPLPoly *poly, TPPLPolyList *parts) {
       }
       i = k - gap;
       if ((vertices[i].isConvex) && (dpstates[i][k].visible)) {
-        TypeB(i, i + 1, k, vertices, dpstates);
+        TypeB(i, i + 1, k, vertices, dpstates, &pool);
         for (j = i + 2; j < k; j++) {
           if (vertices[j].isConvex) {
             continue;
           }
-          TypeB(i, j, k, vertices, dpstates);
+          TypeB(i, j, k, vertices, dpstates, &pool);
         }
       }
     }
   }
 
-  // Recover solution.
+  // Recover solution. Each diagonal splits off at most two more, so
+  // there are fewer than 2 * n of them in total.
+  diagonals = workspace.Get(workspace.diagonals, 2 * n);
+  diagonals2 = workspace.Get(workspace.diagonals2, 2 * n);
+  indices = workspace.Get(workspace.partindices, n);
   ret = 1;
-  newdiagonal.index1 = 0;
-  newdiagonal.index2 = n - 1;
-  diagonals.push_front(newdiagonal);
-  while (!diagonals.empty()) {
-    diagonal = *(diagonals.begin());
-    diagonals.pop_front();
+  numdiagonals = 0;
+  diagonals[numdiagonals].index1 = 0;
+  diagonals[numdiagonals].index2 = n - 1;
+  numdiagonals++;
+  while (numdiagonals > 0) {
+    diagonal = diagonals[--numdiagonals];
     if ((diagonal.index2 - diagonal.index1) <= 1) {
       continue;
     }
-    pairs = &(dpstates[diagonal.index1][diagonal.index2].pairs);
-    if (pairs->empty()) {
+    state = &(dpstates[diagonal.index1][diagonal.index2]);
+    if (state->front == -1) {
       ret = 0;
       break;
     }
     if (!vertices[diagonal.index1].isConvex) {
-      iter = pairs->end();
-      iter--;
-      j = iter->index2;
+      node = &(pool.nodes[state->back]);
+      j = node->index2;
       newdiagonal.index1 = j;
       newdiagonal.index2 = diagonal.index2;
-      diagonals.push_front(newdiagonal);
+      diagonals[numdiagonals++] = newdiagonal;
       if ((j - diagonal.index1) > 1) {
-        if (iter->index1 != iter->index2) {
-          pairs2 = &(dpstates[diagonal.index1][j].pairs);
+        if (node->index1 != node->index2) {
+          state2 = &(dpstates[diagonal.index1][j]);
           while (1) {
-            if (pairs2->empty()) {
+            if (state2->back == -1) {
               ret = 0;
               break;
             }
-            iter2 = pairs2->end();
-            iter2--;
-            if (iter->index1 != iter2->index1) {
-              pairs2->pop_back();
+            if (node->index1 != pool.nodes[state2->back].index1) {
+              PopBackDiagonal(state2, &pool);
             } else {
               break;
             }
@@ -1146,25 +3382,24 @@ int TPPLPartition::ConvexPartition_OPT(TPPLPoly *poly, TPPLPolyList *parts) {
         }
         newdiagonal.index1 = diagonal.index1;
         newdiagonal.index2 = j;
-        diagonals.push_front(newdiagonal);
+        diagonals[numdiagonals++] = newdiagonal;
       }
     } else {
-      iter = pairs->begin();
-      j = iter->index1;
+      node = &(pool.nodes[state->front]);
+      j = node->index1;
       newdiagonal.index1 = diagonal.index1;
       newdiagonal.index2 = j;
-      diagonals.push_front(newdiagonal);
+      diagonals[numdiagonals++] = newdiagonal;
       if ((diagonal.index2 - j) > 1) {
-        if (iter->index1 != iter->index2) {
-          pairs2 = &(dpstates[j][diagonal.index2].pairs);
+        if (node->index1 != node->index2) {
+          state2 = &(dpstates[j][diagonal.index2]);
           while (1) {
-            if (pairs2->empty()) {
+            if (state2->front == -1) {
               ret = 0;
               break;
             }
-            iter2 = pairs2->begin();
-            if (iter->index2 != iter2->index2) {
-              pairs2->pop_front();
+            if (node->index2 != pool.nodes[state2->front].index2) {
+              PopFrontDiagonal(state2, &pool);
             } else {
               break;
             }
@@ -1175,57 +3410,53 @@ int TPPLPartition::ConvexPartition_OPT(TPPLPoly *poly, TPPLPolyList *parts) {
         }
         newdiagonal.index1 = j;
         newdiagonal.index2 = diagonal.index2;
-        diagonals.push_front(newdiagonal);
+        diagonals[numdiagonals++] = newdiagonal;
       }
     }
   }
 
   if (ret == 0) {
-    for (i = 0; i < n; i++) {
-      delete[] dpstates[i];
-    }
-    delete[] dpstates;
-    delete[] vertices;
-
     return ret;
   }
 
-  newdiagonal.index1 = 0;
-  newdiagonal.index2 = n - 1;
-  diagonals.push_front(newdiagonal);
-  while (!diagonals.empty()) {
-    diagonal = *(diagonals.begin());
-    diagonals.pop_front();
+  // Both are queues now, diagonals of the parts still to be output and
+  // diagonals2 of the current part.
+  first = 0;
+  numdiagonals = 0;
+  diagonals[numdiagonals].index1 = 0;
+  diagonals[numdiagonals].index2 = n - 1;
+  numdiagonals++;
+  while (first < numdiagonals) {
+    diagonal = diagonals[first++];
     if ((diagonal.index2 - diagonal.index1) <= 1) {
       continue;
     }
 
-    indices.clear();
-    diagonals2.clear();
-    indices.push_back(diagonal.index1);
-    indices.push_back(diagonal.index2);
-    diagonals2.push_front(diagonal);
+    numindices = 0;
+    indices[numindices++] = diagonal.index1;
+    indices[numindices++] = diagonal.index2;
+    first2 = 0;
+    last2 = 0;
+    diagonals2[last2++] = diagonal;
 
-    while (!diagonals2.empty()) {
-      diagonal = *(diagonals2.begin());
-      diagonals2.pop_front();
+    while (first2 < last2) {
+      diagonal = diagonals2[first2++];
       if ((diagonal.index2 - diagonal.index1) <= 1) {
         continue;
       }
       ijreal = true;
       jkreal = true;
-      pairs = &(dpstates[diagonal.index1][diagonal.index2].pairs);
+      state = &(dpstates[diagonal.index1][diagonal.index2]);
       if (!vertices[diagonal.index1].isConvex) {
-        iter = pairs->end();
-        iter--;
-        j = iter->index2;
-        if (iter->index1 != iter->index2) {
+        node = &(pool.nodes[state->back]);
+        j = node->index2;
+        if (node->index1 != node->index2) {
           ijreal = false;
         }
       } else {
-        iter = pairs->begin();
-        j = iter->index1;
-        if (iter->index1 != iter->index2) {
+        node = &(pool.nodes[state->front]);
+        j = node->index1;
+        if (node->index1 != node->index2) {
           jkreal = false;
         }
       }
@@ -1233,37 +3464,30 @@ int TPPLPartition::ConvexPartition_OPT(TPPLPoly *poly, TPPLPolyList *parts) {
       newdiagonal.index1 = diagonal.index1;
       newdiagonal.index2 = j;
       if (ijreal) {
-        diagonals.push_back(newdiagonal);
+        diagonals[numdiagonals++] = newdiagonal;
       } else {
-        diagonals2.push_back(newdiagonal);
+        diagonals2[last2++] = newdiagonal;
       }
 
       newdiagonal.index1 = j;
       newdiagonal.index2 = diagonal.index2;
       if (jkreal) {
-        diagonals.push_back(newdiagonal);
+        diagonals[numdiagonals++] = newdiagonal;
       } else {
-        diagonals2.push_back(newdiagonal);
+        diagonals2[last2++] = newdiagonal;
       }
 
-      indices.push_back(j);
+      indices[numindices++] = j;
     }
 
-    std::sort(indices.begin(), indices.end());
-    newpoly.Init((long)indices.size());
-    k = 0;
-    for (iiter = indices.begin(); iiter != indices.end(); iiter++) {
-      newpoly[k] = vertices[*iiter].p;
-      k++;
+    // The part is built in place in the output list.
+    std::sort(indices, indices + numindices);
+    parts->push_back(TPPLPoly());
+    parts->back().Init(numindices);
+    for (k = 0; k < numindices; k++) {
+      parts->back()[k] = vertices[indices[k]].p;
     }
-    parts->push_back(newpoly);
-  }
-
-  for (i = 0; i < n; i++) {
-    delete[] dpstates[i];
   }
-  delete[] dpstates;
-  delete[] vertices;
 
   return ret;
 }
@@ -1276,34 +3500,30 @@ int TPPLPartition::ConvexPartition_OPT(TPPLPoly *poly, TPPLPolyList *parts) {
 // The algorithm used here is outlined in the book
 // "Computational Geometry: Algorithms and Applications"
 // by Mark de Berg, Otfried Cheong, Marc van Kreveld, and Mark Overmars.
-int TPPLPartition::MonotonePartition(TPPLPolyList *inpolys, TPPLPolyList *monotonePolys) {
-  TPPLPolyList::iterator iter;
+int TPPLPartition::MonotonePartition(TPPLPoly **polys, long numpolys, long *numpieces) {
   MonotoneVertex *vertices = NULL;
-  long i, numvertices, vindex, vindex2, newnumvertices, maxnumvertices;
-  long polystartindex, polyendindex;
+  long i, numvertices;
+  long polystartindex, polyendindex, polyindex;
   TPPLPoly *poly = NULL;
-  MonotoneVertex *v = NULL, *v2 = NULL, *vprev = NULL, *vnext = NULL;
-  ScanLineEdge newedge;
-  bool error = false;
 
+  *numpieces = 0;
   numvertices = 0;
-  for (iter = inpolys->begin(); iter != inpolys->end(); iter++) {
-    if (!iter->Valid()) {
+  for (i = 0; i < numpolys; i++) {
+    if (!polys[i]->Valid()) {
       return 0;
     }
-    numvertices += iter->GetNumPoints();
+    numvertices += polys[i]->GetNumPoints();
   }
 
-  maxnumvertices = numvertices * 3;
-  vertices = new MonotoneVertex[maxnumvertices];
-  newnumvertices = numvertices;
+  vertices = workspace.Get(workspace.monotonevertices, numvertices * 3);
 
   polystartindex = 0;
-  for (iter = inpolys->begin(); iter != inpolys->end(); iter++) {
-    poly = &(*iter);
+  for (polyindex = 0; polyindex < numpolys; polyindex++) {
+    poly = polys[polyindex];
     polyendindex = polystartindex + poly->GetNumPoints() - 1;
     for (i = 0; i < poly->GetNumPoints(); i++) {
       vertices[i + polystartindex].p = poly->GetPoint(i);
+      vertices[i + polystartindex].index = i + polystartindex;
       if (i == 0) {
         vertices[i + polystartindex].previous = polyendindex;
       } else {
@@ -1318,28 +3538,48 @@ int TPPLPartition::MonotonePartition(TPPLPolyList *inpolys, TPPLPolyList *monoto
     polystartindex = polyendindex + 1;
   }
 
+  return MonotonePartition(numvertices, numpieces);
+}
+
+int TPPLPartition::MonotonePartition(long numvertices, long *numpieces) {
+  MonotoneVertex *vertices = NULL;
+  long i, vindex, vindex2, newnumvertices, maxnumvertices;
+  MonotoneVertex *v = NULL, *v2 = NULL, *vprev = NULL, *vnext = NULL;
+  ScanLineEdge newedge;
+  bool error = false;
+
+  *numpieces = 0;
+  maxnumvertices = numvertices * 3;
+  vertices = workspace.monotonevertices.data;
+  newnumvertices = numvertices;
+
   // Construct the priority queue.
-  long *priority = new long[numvertices];
+  long *priority = workspace.Get(workspace.priority, numvertices);
   for (i = 0; i < numvertices; i++) {
     priority[i] = i;
   }
-  std::sort(priority, &(priority[numvertices]), VertexSorter(vertices));
+  SortVertices(vertices, priority, numvertices);
 
-  // Determine vertex types.
-  TPPLVertexType *vertextypes = new TPPLVertexType[maxnumvertices];
+  // Determine vertex types. Each polygon occupies a run of vertices that
+  // ends at the previous vertex of its first one.
+  signed char *orientations = workspace.Get(workspace.orientations, numvertices);
+  for (i = 0; i < numvertices; i = vertices[i].previous + 1) {
+    ClassifyVertices(&(vertices[i].p), sizeof(MonotoneVertex), vertices[i].previous - i + 1, &(orientations[i]));
+  }
+  TPPLVertexType *vertextypes = workspace.Get(workspace.vertextypes, maxnumvertices);
   for (i = 0; i < numvertices; i++) {
     v = &(vertices[i]);
     vprev = &(vertices[v->previous]);
     vnext = &(vertices[v->next]);
 
     if (Below(vprev->p, v->p) && Below(vnext->p, v->p)) {
-      if (IsConvex(vnext->p, vprev->p, v->p)) {
+      if (orientations[i] > 0) {
         vertextypes[i] = TPPL_VERTEXTYPE_START;
       } else {
         vertextypes[i] = TPPL_VERTEXTYPE_SPLIT;
       }
     } else if (Below(v->p, vprev->p) && Below(v->p, vnext->p)) {
-      if (IsConvex(vnext->p, vprev->p, v->p)) {
+      if (orientations[i] > 0) {
         vertextypes[i] = TPPL_VERTEXTYPE_END;
       } else {
         vertextypes[i] = TPPL_VERTEXTYPE_MERGE;
@@ -1350,18 +3590,24 @@ int TPPLPartition::MonotonePartition(TPPLPolyList *inpolys, TPPLPolyList *monoto
   }
 
   // Helpers.
-  long *helpers = new long[maxnumvertices];
+  long *helpers = workspace.Get(workspace.helpers, maxnumvertices);
 
   // Binary search tree that holds edges intersecting the scanline.
   // Note that while set doesn't actually have to be implemented as
   // a tree, complexity requirements for operations are the same as
   // for the balanced binary search tree.
-  std::set<ScanLineEdge> edgeTree;
+#ifdef TPPL_SCANLINE_SKIPLIST
+  // Every edge is inserted at most once, so one node per vertex suffices.
+  ScanLineEdgeTree edgeTree(workspace.Get(workspace.scanlinememory, ScanLineSkipList::MemorySize(maxnumvertices)), maxnumvertices);
+#else
+  // The tree nodes come from the workspace node pool.
+  ScanLineEdgeTree edgeTree(PoolAllocator<ScanLineEdge>(&workspace.nodepool));
+#endif
   // Store iterators to the edge tree elements.
   // This makes deleting existing edges much faster.
-  std::set<ScanLineEdge>::iterator *edgeTreeIterators, edgeIter;
-  edgeTreeIterators = new std::set<ScanLineEdge>::iterator[maxnumvertices];
-  std::pair<std::set<ScanLineEdge>::iterator, bool> edgeTreeRet;
+  ScanLineEdgeTree::iterator *edgeTreeIterators, edgeIter;
+  edgeTreeIterators = workspace.Get(workspace.edgetreeiterators, maxnumvertices);
+  std::pair<ScanLineEdgeTree::iterator, bool> edgeTreeRet;
   for (i = 0; i < numvertices; i++) {
     edgeTreeIterators[i] = edgeTree.end();
   }
@@ -1485,7 +3731,7 @@ int TPPLPartition::MonotonePartition(TPPLPolyList *inpolys, TPPLPolyList *monoto
           newedge.index = vindex2;
           edgeTreeRet = edgeTree.insert(newedge);
           edgeTreeIterators[vindex2] = edgeTreeRet.first;
-          helpers[vindex2] = vindex;
+          helpers[vindex2] = vindex2;
         } else {
           // Search in T to find the edge e_j directly left of v_i.
           newedge.p1 = v->p;
@@ -1512,49 +3758,34 @@ int TPPLPartition::MonotonePartition(TPPLPolyList *inpolys, TPPLPolyList *monoto
       break;
   }
 
-  char *used = new char[newnumvertices];
-  memset(used, 0, newnumvertices * sizeof(char));
-
   if (!error) {
     // Return result.
-    long size;
-    TPPLPoly mpoly;
+    char *used = workspace.Get(workspace.used, newnumvertices);
+    long *pieces = workspace.Get(workspace.pieces, newnumvertices);
+    long *piecestarts = workspace.Get(workspace.piecestarts, newnumvertices + 1);
+    long numpiecevertices = 0;
+
+    memset(used, 0, newnumvertices * sizeof(char));
+    piecestarts[0] = 0;
     for (i = 0; i < newnumvertices; i++) {
       if (used[i]) {
         continue;
       }
       v = &(vertices[i]);
+      pieces[numpiecevertices++] = i;
       vnext = &(vertices[v->next]);
-      size = 1;
-      while (vnext != v) {
-        vnext = &(vertices[vnext->next]);
-        size++;
-      }
-      mpoly.Init(size);
-      v = &(vertices[i]);
-      mpoly[0] = v->p;
-      vnext = &(vertices[v->next]);
-      size = 1;
       used[i] = 1;
       used[v->next] = 1;
       while (vnext != v) {
-        mpoly[size] = vnext->p;
+        pieces[numpiecevertices++] = vnext - vertices;
         used[vnext->next] = 1;
         vnext = &(vertices[vnext->next]);
-        size++;
       }
-      monotonePolys->push_back(mpoly);
+      (*numpieces)++;
+      piecestarts[*numpieces] = numpiecevertices;
     }
   }
 
-  // Cleanup.
-  delete[] vertices;
-  delete[] priority;
-  delete[] vertextypes;
-  delete[] edgeTreeIterators;
-  delete[] helpers;
-  delete[] used;
-
   if (error) {
     return 0;
   } else {
@@ -1562,10 +3793,38 @@ int TPPLPartition::MonotonePartition(TPPLPolyList *inpolys, TPPLPolyList *monoto
   }
 }
 
+int TPPLPartition::MonotonePartition(TPPLPolyList *inpolys, TPPLPolyList *monotonePolys) {
+  TPPLPolyList::iterator iter;
+  TPPLPoly **polys = NULL;
+  TPPLPoly mpoly;
+  long i, j, numpolys, numpieces;
+
+  polys = workspace.Get(workspace.polys, (long)inpolys->size());
+  numpolys = 0;
+  for (iter = inpolys->begin(); iter != inpolys->end(); iter++) {
+    polys[numpolys++] = &(*iter);
+  }
+  if (!MonotonePartition(polys, numpolys, &numpieces)) {
+    return 0;
+  }
+
+  MonotoneVertex *vertices = workspace.monotonevertices.data;
+  long *pieces = workspace.pieces.data;
+  long *piecestarts = workspace.piecestarts.data;
+  for (i = 0; i < numpieces; i++) {
+    mpoly.Init(piecestarts[i + 1] - piecestarts[i]);
+    for (j = piecestarts[i]; j < piecestarts[i + 1]; j++) {
+      mpoly[j - piecestarts[i]] = vertices[pieces[j]].p;
+    }
+    monotonePolys->push_back(std::move(mpoly));
+  }
+  return 1;
+}
+
 // Adds a diagonal to the doubly-connected list of vertices.
 void TPPLPartition::AddDiagonal(MonotoneVertex *vertices, long *numvertices, long index1, long index2,
-        TPPLVertexType *vertextypes, std::set<ScanLineEdge>::iterator *edgeTreeIterators,
-        std::set<ScanLineEdge> *edgeTree, long *helpers) {
+        TPPLVertexType *vertextypes, ScanLineEdgeTree::iterator *edgeTreeIterators,
+        ScanLineEdgeTree *edgeTree, long *helpers) {
   long newindex1, newindex2;
 
   newindex1 = *numvertices;
@@ -1575,6 +3834,8 @@ void TPPLPartition::AddDiagonal(MonotoneVertex *vertices, long *numvertices, lon
 
   vertices[newindex1].p = vertices[index1].p;
   vertices[newindex2].p = vertices[index2].p;
+  vertices[newindex1].index = vertices[index1].index;
+  vertices[newindex2].index = vertices[index2].index;
 
   vertices[newindex2].next = vertices[index2].next;
   vertices[newindex1].next = vertices[index1].next;
@@ -1614,6 +3875,85 @@ bool TPPLPartition::Below(TPPLPoint &p1, TPPLPoint &p2) {
   return false;
 }
 
+// Maps value to an integer with the same order.
+uint64_t TPPLPartition::SortKey(tppl_coord value) {
+  const uint64_t sign = (uint64_t)1 << (8 * sizeof(tppl_coord) - 1);
+  uint64_t bits = 0;
+
+#ifdef TPPL_USE_INT32
+  // Two's complement only needs the sign bit flipped.
+  bits = (uint32_t)value;
+  return bits ^ sign;
+#else
+  // Adding 0 turns -0 into 0, the two compare equal.
+  value += 0;
+  memcpy(&bits, &value, sizeof(tppl_coord));
+  if (bits & sign) {
+    // Negative values sort in reverse order of their magnitude.
+    return ~bits & (sign | (sign - 1));
+  }
+  return bits | sign;
+#endif
+}
+
+// Sorts the vertex indices in priority the same way as VertexSorter.
+// Larger inputs are sorted by y with an LSD radix sort on the keys of the
+// y coordinates, a byte at a time, skipping the bytes all keys have in
+// common. Runs of equal y are then sorted by x.
+void TPPLPartition::SortVertices(MonotoneVertex *vertices, long *priority, long numvertices) {
+  VertexKey *keys = NULL, *sortedkeys = NULL, *swap = NULL;
+  long *counts = NULL;
+  long i, j, digit, total, count;
+
+  if (numvertices < 256) {
+    std::sort(priority, &(priority[numvertices]), VertexSorter(vertices));
+    return;
+  }
+
+  keys = workspace.Get(workspace.vertexkeys, numvertices);
+  sortedkeys = workspace.Get(workspace.sortedvertexkeys, numvertices);
+  counts = workspace.Get(workspace.radixcounts, 8 * 256);
+  memset(counts, 0, 8 * 256 * sizeof(long));
+
+  // Keys are complemented so that larger coordinates come first.
+  for (i = 0; i < numvertices; i++) {
+    keys[i].key = ~SortKey(vertices[priority[i]].p.y);
+    keys[i].index = priority[i];
+    for (digit = 0; digit < 8; digit++) {
+      counts[digit * 256 + ((keys[i].key >> (8 * digit)) & 0xFF)]++;
+    }
+  }
+
+  for (digit = 0; digit < 8; digit++) {
+    if (counts[digit * 256 + ((keys[0].key >> (8 * digit)) & 0xFF)] == numvertices) {
+      continue;
+    }
+    total = 0;
+    for (i = 0; i < 256; i++) {
+      count = counts[digit * 256 + i];
+      counts[digit * 256 + i] = total;
+      total += count;
+    }
+    for (i = 0; i < numvertices; i++) {
+      sortedkeys[counts[digit * 256 + ((keys[i].key >> (8 * digit)) & 0xFF)]++] = keys[i];
+    }
+    swap = keys;
+    keys = sortedkeys;
+    sortedkeys = swap;
+  }
+
+  for (i = 0; i < numvertices; i++) {
+    priority[i] = keys[i].index;
+  }
+  for (i = 0; i < numvertices; i = j) {
+    for (j = i + 1; (j < numvertices) && (keys[j].key == keys[i].key); j++) {
+    }
+    if ((j - i) > 1) {
+      std::sort(&(priority[i]), &(priority[j]), VertexSorter(vertices));
+    }
+  }
+}
+
 // Sorts in the falling order of y values, if y is equal, x is used instead.
 bool TPPLPartition::VertexSorter::operator()(long index1, long index2) {
   if (vertices[index1].p.y > vertices[index2].p.y) {
@@ -1627,13 +3967,7 @@ bool TPPLPartition::VertexSorter::operator()(long index1, long index2) {
 }
 
 bool TPPLPartition::ScanLineEdge::IsConvex(const TPPLPoint &p1, const TPPLPoint &p2, const TPPLPoint &p3) const {
-  tppl_float tmp;
-  tmp = (p3.y - p1.y) * (p2.x - p1.x) - (p3.x - p1.x) * (p2.y - p1.y);
-  if (tmp > 0) {
-    return 1;
-  }
-
-  return 0;
+  return Orientation(p1, p2, p3) > 0;
 }
 
 bool TPPLPartition::ScanLineEdge::operator<(const ScanLineEdge &other) const {
@@ -1654,22 +3988,17 @@ bool TPPLPartition::ScanLineEdge::operator<(const ScanLineEdge &other) const {
 // Triangulates monotone polygon.
 // Time complexity: O(n)
 // Space complexity: O(n)
-int TPPLPartition::TriangulateMonotone(TPPLPoly *inPoly, TPPLPolyList *triangles) {
-  if (!inPoly->Valid()) {
+int TPPLPartition::TriangulateMonotone(TPPLPoint *points, long *pointindices, long numpoints, uint32_t *indices, long *numtriangles,
+        MonotoneScratch *scratch) {
+  if (numpoints < 3) {
     return 0;
   }
 
   long i, i2, j, topindex, bottomindex, leftindex, rightindex, vindex;
-  TPPLPoint *points = NULL;
-  long numpoints;
-  TPPLPoly triangle;
-
-  numpoints = inPoly->GetNumPoints();
-  points = inPoly->GetPoints();
 
   // Trivial case.
   if (numpoints == 3) {
-    triangles->push_back(*inPoly);
+    AddTriangle(indices, numtriangles, pointindices[0], pointindices[1], pointindices[2]);
     return 1;
   }
 
@@ -1708,8 +4037,8 @@ int TPPLPartition::TriangulateMonotone(TPPLPoly *inPoly, TPPLPolyList *triangles
     i = i2;
   }
 
-  char *vertextypes = new char[numpoints];
-  long *priority = new long[numpoints];
+  char *vertextypes = scratch->vertextypes;
+  long *priority = scratch->priority;
 
   // Merge left and right vertex chains.
   priority[0] = topindex;
@@ -1758,7 +4087,7 @@ int TPPLPartition::TriangulateMonotone(TPPLPoly *inPoly, TPPLPolyList *triangles
   priority[i] = bottomindex;
   vertextypes[bottomindex] = 0;
 
-  long *stack = new long[numpoints];
+  long *stack = scratch->stack;
   long stackptr = 0;
 
   stack[0] = priority[0];
@@ -1771,11 +4100,10 @@ int TPPLPartition::TriangulateMonotone(TPPLPoly *inPoly, TPPLPolyList *triangles
     if (vertextypes[vindex] != vertextypes[stack[stackptr - 1]]) {
       for (j = 0; j < (stackptr - 1); j++) {
         if (vertextypes[vindex] == 1) {
-          triangle.Triangle(points[stack[j + 1]], points[stack[j]], points[vindex]);
+          AddTriangle(indices, numtriangles, pointindices[stack[j + 1]], pointindices[stack[j]], pointindices[vindex]);
         } else {
-          triangle.Triangle(points[stack[j]], points[stack[j + 1]], points[vindex]);
+          AddTriangle(indices, numtriangles, pointindices[stack[j]], pointindices[stack[j + 1]], pointindices[vindex]);
         }
-        triangles->push_back(triangle);
       }
       stack[0] = priority[i - 1];
       stack[1] = priority[i];
@@ -1785,16 +4113,14 @@ int TPPLPartition::TriangulateMonotone(TPPLPoly *inPoly, TPPLPolyList *triangles
       while (stackptr > 0) {
         if (vertextypes[vindex] == 1) {
           if (IsConvex(points[vindex], points[stack[stackptr - 1]], points[stack[stackptr]])) {
-            triangle.Triangle(points[vindex], points[stack[stackptr - 1]], points[stack[stackptr]]);
-            triangles->push_back(triangle);
+            AddTriangle(indices, numtriangles, pointindices[vindex], pointindices[stack[stackptr - 1]], pointindices[stack[stackptr]]);
             stackptr--;
           } else {
             break;
           }
         } else {
           if (IsConvex(points[vindex], points[stack[stackptr]], points[stack[stackptr - 1]])) {
-            triangle.Triangle(points[vindex], points[stack[stackptr]], points[stack[stackptr - 1]]);
-            triangles->push_back(triangle);
+            AddTriangle(indices, numtriangles, pointindices[vindex], pointindices[stack[stackptr]], pointindices[stack[stackptr - 1]]);
             stackptr--;
           } else {
             break;
@@ -1809,38 +4135,294 @@ int TPPLPartition::TriangulateMonotone(TPPLPoly *inPoly, TPPLPolyList *triangles
   vindex = priority[i];
   for (j = 0; j < (stackptr - 1); j++) {
     if (vertextypes[stack[j + 1]] == 1) {
-      triangle.Triangle(points[stack[j]], points[stack[j + 1]], points[vindex]);
+      AddTriangle(indices, numtriangles, pointindices[stack[j]], pointindices[stack[j + 1]], pointindices[vindex]);
     } else {
-      triangle.Triangle(points[stack[j + 1]], points[stack[j]], points[vindex]);
+      AddTriangle(indices, numtriangles, pointindices[stack[j + 1]], pointindices[stack[j]], pointindices[vindex]);
     }
-    triangles->push_back(triangle);
   }
 
-  delete[] priority;
-  delete[] vertextypes;
-  delete[] stack;
-
   return 1;
 }
 
-int TPPLPartition::Triangulate_MONO(TPPLPolyList *inpolys, TPPLPolyList *triangles) {
-  TPPLPolyList monotone;
-  TPPLPolyList::iterator iter;
+int TPPLPartition::Triangulate_MONO(TPPLPoly **polys, long numpolys, uint32_t *indices, long *numtriangles) {
+  long i, numpieces, maxnumtriangles;
+
+  *numtriangles = 0;
+  if (!MonotonePartition(polys, numpolys, &numpieces)) {
+    return 0;
+  }
+
+  // A valid partition of n vertices and h holes never has more than
+  // n + 2 * h - 2 triangles; anything else would overrun the caller's buffer.
+  maxnumtriangles = -2;
+  for (i = 0; i < numpolys; i++) {
+    maxnumtriangles += polys[i]->GetNumPoints();
+    if (polys[i]->IsHole()) {
+      maxnumtriangles += 2;
+    }
+  }
+  return TriangulateMonotonePieces(numpieces, maxnumtriangles, indices, numtriangles);
+}
 
-  if (!MonotonePartition(inpolys, &monotone)) {
+int TPPLPartition::TriangulateMonotonePieces(long numpieces, long maxnumtriangles, uint32_t *indices, long *numtriangles) {
+  MonotoneVertex *vertices = NULL;
+  long *pieces = NULL, *piecestarts = NULL;
+  MonotoneScratch *scratch = NULL;
+  long i, j, numthreads, maxnumpoints, first;
+
+  // Piece i of n points gives n - 2 triangles, so it can write its
+  // triangles from first + piecestarts[i] - 2 * i on, independently of the
+  // other pieces.
+  struct Pieces {
+    TPPLPartition *partition;
+    TPPLPoint *points;
+    long *pieces;
+    long *piecestarts;
+    uint32_t *indices;
+    long *piecenumtriangles;
+    MonotoneScratch *scratch;
+
+    void operator()(long begin, long end, long thread) {
+      long i, j;
+      for (i = begin; i < end; i++) {
+        j = piecestarts[i];
+        piecenumtriangles[i] = 0;
+        if (!partition->TriangulateMonotone(&(points[j]), &(pieces[j]), piecestarts[i + 1] - j,
+                    &(indices[3 * (j - 2 * i)]), &(piecenumtriangles[i]), &(scratch[thread]))) {
+          piecenumtriangles[i] = -1;
+        }
+      }
+    }
+  } task;
+
+  vertices = workspace.monotonevertices.data;
+  pieces = workspace.pieces.data;
+  piecestarts = workspace.piecestarts.data;
+
+  if (piecestarts[numpieces] - 2 * numpieces > maxnumtriangles) {
     return 0;
   }
-  for (iter = monotone.begin(); iter != monotone.end(); iter++) {
-    if (!TriangulateMonotone(&(*iter), triangles)) {
+
+  // Gather the points of each piece and map its vertices back to input positions.
+  task.points = workspace.Get(workspace.piecepoints, piecestarts[numpieces]);
+  for (i = 0; i < piecestarts[numpieces]; i++) {
+    task.points[i] = vertices[pieces[i]].p;
+    pieces[i] = vertices[pieces[i]].index;
+  }
+
+  maxnumpoints = 0;
+  for (i = 0; i < numpieces; i++) {
+    maxnumpoints = std::max(maxnumpoints, piecestarts[i + 1] - piecestarts[i]);
+  }
+  numthreads = threadpool.GetNumThreads();
+  scratch = workspace.Get(workspace.monotonescratch, numthreads);
+  for (i = 0; i < numthreads; i++) {
+    scratch[i].vertextypes = workspace.Get(scratch[i].typebuffer, maxnumpoints);
+    scratch[i].priority = workspace.Get(scratch[i].prioritybuffer, maxnumpoints);
+    scratch[i].stack = workspace.Get(scratch[i].stackbuffer, maxnumpoints);
+  }
+
+  first = *numtriangles;
+  task.partition = this;
+  task.pieces = pieces;
+  task.piecestarts = piecestarts;
+  task.indices = indices + 3 * first;
+  task.piecenumtriangles = workspace.Get(workspace.piecenumtriangles, numpieces);
+  task.scratch = scratch;
+  threadpool.Run(numpieces, 64, task);
+
+  // Concatenate the parts, in case a piece gave fewer triangles, and
+  // stop at the first piece that failed, as when running in order.
+  for (i = 0; i < numpieces; i++) {
+    if (task.piecenumtriangles[i] < 0) {
       return 0;
     }
+    j = first + piecestarts[i] - 2 * i;
+    if (j != *numtriangles) {
+      memmove(indices + 3 * (*numtriangles), indices + 3 * j, 3 * task.piecenumtriangles[i] * sizeof(uint32_t));
+    }
+    *numtriangles += task.piecenumtriangles[i];
   }
   return 1;
 }
 
+int TPPLPartition::Triangulate_MONO(TPPLPolyList *inpolys, uint32_t *indices, long *numtriangles) {
+  TPPLPolyList::iterator iter;
+  TPPLPoly **polys = NULL;
+  long numpolys;
+
+  polys = workspace.Get(workspace.polys, (long)inpolys->size());
+  numpolys = 0;
+  for (iter = inpolys->begin(); iter != inpolys->end(); iter++) {
+    polys[numpolys++] = &(*iter);
+  }
+  return Triangulate_MONO(polys, numpolys, indices, numtriangles);
+}
+
+int TPPLPartition::Triangulate_MONO(TPPLPolyList *inpolys, TPPLPolyList *triangles) {
+  TPPLPolyList::iterator iter;
+  TPPLPoint *points = NULL;
+  uint32_t *indices = NULL;
+  long i, numpoints, numholes, numtriangles;
+  int ret;
+
+  numpoints = 0;
+  numholes = 0;
+  for (iter = inpolys->begin(); iter != inpolys->end(); iter++) {
+    numpoints += iter->GetNumPoints();
+    if (iter->IsHole()) {
+      numholes++;
+    }
+  }
+  points = workspace.Get(workspace.points, numpoints);
+  indices = workspace.Get(workspace.indices, 3 * (numpoints + 2 * numholes));
+  numpoints = 0;
+  for (iter = inpolys->begin(); iter != inpolys->end(); iter++) {
+    for (i = 0; i < iter->GetNumPoints(); i++) {
+      points[numpoints++] = iter->GetPoint(i);
+    }
+  }
+
+  ret = Triangulate_MONO(inpolys, indices, &numtriangles);
+  AddTriangles(points, indices, numtriangles, triangles);
+
+  return ret;
+}
+
+int TPPLPartition::Triangulate_MONO(TPPLPolyList *groups, long numgroups, TPPLPolyList *triangles, int *statuses) {
+  return RunBatch(BATCH_TRIANGULATE_MONO, groups, numgroups, triangles, statuses);
+}
+
+int TPPLPartition::Triangulate_MONO(TPPLPoly *poly, uint32_t *indices, long *numtriangles) {
+  return Triangulate_MONO(&poly, 1, indices, numtriangles);
+}
+
 int TPPLPartition::Triangulate_MONO(TPPLPoly *poly, TPPLPolyList *triangles) {
-  TPPLPolyList polys;
-  polys.push_back(*poly);
+  if (!poly->Valid()) {
+    return 0;
+  }
+
+  uint32_t *indices = workspace.Get(workspace.indices, 3 * (poly->GetNumPoints() - 2));
+  long numtriangles;
+  int ret;
 
-  return Triangulate_MONO(&polys, triangles);
+  ret = Triangulate_MONO(&poly, 1, indices, &numtriangles);
+  AddTriangles(poly->GetPoints(), indices, numtriangles, triangles);
+
+  return ret;
+}
+
+bool TPPLPartition::IsConvexPolygon(const TPPLPoint *points, long numpoints, const signed char *orientations) {
+  long i, direction, previousdirection, numreversals;
+
+  for (i = 0; i < numpoints; i++) {
+    if (orientations[i] <= 0) {
+      return false;
+    }
+  }
+
+  // Turning left everywhere, the polygon could still wind around more
+  // than once. It doesn't if x only reverses direction twice.
+  previousdirection = 0;
+  for (i = numpoints - 1; (i >= 0) && (previousdirection == 0); i--) {
+    if (points[(i + 1) % numpoints].x != points[i].x) {
+      previousdirection = (points[(i + 1) % numpoints].x > points[i].x) ? 1 : -1;
+    }
+  }
+  numreversals = 0;
+  for (i = 0; i < numpoints; i++) {
+    if (points[(i + 1) % numpoints].x == points[i].x) {
+      continue;
+    }
+    direction = (points[(i + 1) % numpoints].x > points[i].x) ? 1 : -1;
+    if (direction != previousdirection) {
+      numreversals++;
+    }
+    previousdirection = direction;
+  }
+  return numreversals == 2;
+}
+
+int TPPLPartition::TriangulateAuto(TPPLPoint *points, long numpoints, uint32_t *indices, long *numtriangles) {
+  signed char *orientations = NULL;
+  long *pointindices = NULL;
+  MonotoneScratch *scratch = NULL;
+  long i;
+
+  if (numpoints == 3) {
+    AddTriangle(indices, numtriangles, 0, 1, 2);
+    return 1;
+  }
+
+  orientations = workspace.Get(workspace.orientations, numpoints);
+  ClassifyVertices(points, sizeof(TPPLPoint), numpoints, orientations);
+  if (IsConvexPolygon(points, numpoints, orientations)) {
+    for (i = 1; i < numpoints - 1; i++) {
+      AddTriangle(indices, numtriangles, 0, i, i + 1);
+    }
+    return 1;
+  }
+
+  // TriangulateMonotone checks monotonicity before writing any triangles.
+  pointindices = workspace.Get(workspace.pieces, numpoints);
+  for (i = 0; i < numpoints; i++) {
+    pointindices[i] = i;
+  }
+  scratch = workspace.Get(workspace.monotonescratch, 1);
+  scratch->vertextypes = workspace.Get(scratch->typebuffer, numpoints);
+  scratch->priority = workspace.Get(scratch->prioritybuffer, numpoints);
+  scratch->stack = workspace.Get(scratch->stackbuffer, numpoints);
+  if (TriangulateMonotone(points, pointindices, numpoints, indices, numtriangles, scratch)) {
+    return 1;
+  }
+
+  if (numpoints <= MAXAUTOEARPOINTS) {
+    return TriangulateEarsZ(points, numpoints, indices, numtriangles, false);
+  }
+  return -1;
+}
+
+int TPPLPartition::Triangulate_Auto(TPPLPoly *poly, uint32_t *indices, long *numtriangles) {
+  int ret;
+
+  *numtriangles = 0;
+  if (!poly->Valid()) {
+    return 0;
+  }
+  ret = TriangulateAuto(poly->GetPoints(), poly->GetNumPoints(), indices, numtriangles);
+  if (ret >= 0) {
+    return ret;
+  }
+  return Triangulate_MONO(poly, indices, numtriangles);
+}
+
+int TPPLPartition::Triangulate_Auto(TPPLPoly *poly, TPPLPolyList *triangles) {
+  if (!poly->Valid()) {
+    return 0;
+  }
+
+  uint32_t *indices = workspace.Get(workspace.indices, 3 * (poly->GetNumPoints() - 2));
+  long numtriangles;
+  int ret;
+
+  ret = Triangulate_Auto(poly, indices, &numtriangles);
+  AddTriangles(poly->GetPoints(), indices, numtriangles, triangles);
+
+  return ret;
+}
+
+int TPPLPartition::Triangulate_Auto(TPPLPolyList *inpolys, TPPLPolyList *triangles) {
+  TPPLPolyList::iterator iter;
+
+  for (iter = inpolys->begin(); iter != inpolys->end(); iter++) {
+    if (iter->IsHole()) {
+      return Triangulate_MONO(inpolys, triangles);
+    }
+  }
+  for (iter = inpolys->begin(); iter != inpolys->end(); iter++) {
+    if (!Triangulate_Auto(&(*iter), triangles)) {
+      return 0;
+    }
+  }
+  return 1;
 }
@@ -24,11 +24,45 @@
 #ifndef POLYPARTITION_H
 #define POLYPARTITION_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
 #include <list>
+#include <mutex>
 #include <set>
+#include <thread>
+#include <utility>
 
+// Coordinate type. Defining TPPL_USE_FLOAT stores coordinates as float,
+// halving the size of TPPLPoint. The geometric predicates evaluate in
+// double in either case, falling back to exact arithmetic when rounding
+// could have changed their result.
+// Defining TPPL_USE_INT32 instead stores coordinates as 32-bit integers,
+// for input already quantized to a grid. The predicates are then exact,
+// using 64-bit products, or 128-bit ones for coordinates beyond +-2^30.
+// tppl_float is the type of derived values such as lengths, angles and
+// weights. It stays double with float coordinates, since the triangulation
+// weights of Triangulate_OPT sum up many lengths and the ear angles need
+// to order nearly equal values.
+#if defined(TPPL_USE_INT32)
+typedef int32_t tppl_coord;
+#elif defined(TPPL_USE_FLOAT)
+typedef float tppl_coord;
+#else
+typedef double tppl_coord;
+#endif
 typedef double tppl_float;
 
+// The vertex classification passes use SSE2, and AVX where the CPU
+// supports it, for double coordinates on x86. Define TPPL_NO_SIMD to use
+// scalar code only.
+#if !defined(TPPL_NO_SIMD) && !defined(TPPL_USE_FLOAT) && !defined(TPPL_USE_INT32) && \
+        (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define TPPL_SIMD
+#endif
+
 enum TPPLOrientation {
   TPPL_ORIENTATION_CW = -1,
   TPPL_ORIENTATION_NONE = 0,
@@ -45,8 +79,8 @@ enum TPPLVertexType {
 
 // 2D point structure.
 struct TPPLPoint {
-  tppl_float x;
-  tppl_float y;
+  tppl_coord x;
+  tppl_coord y;
   // User-specified vertex identifier. Note that this isn't used internally
   // by the library, but will be faithfully copied around.
   int id;
@@ -67,15 +101,15 @@ struct TPPLPoint {
 
   TPPLPoint operator*(const tppl_float f) const {
     TPPLPoint r;
-    r.x = x * f;
-    r.y = y * f;
+    r.x = (tppl_coord)(x * f);
+    r.y = (tppl_coord)(y * f);
     return r;
   }
 
   TPPLPoint operator/(const tppl_float f) const {
     TPPLPoint r;
-    r.x = x / f;
-    r.y = y / f;
+    r.x = (tppl_coord)(x / f);
+    r.y = (tppl_coord)(y / f);
     return r;
   }
 
@@ -91,9 +125,16 @@ struct TPPLPoint {
 // Polygon implemented as an array of points with a "hole" flag.
 class TPPLPoly {
   protected:
+  enum {
+    NUMINLINEPOINTS = 4
+  };
+
+  // Points of the polygon, inlinepoints for small polygons and a heap
+  // array otherwise.
   TPPLPoint *points;
   long numpoints;
   bool hole;
+  TPPLPoint inlinepoints[NUMINLINEPOINTS];
 
   public:
   // Constructors and destructors.
@@ -103,6 +144,12 @@ class TPPLPoly {
   TPPLPoly(const TPPLPoly &src);
   TPPLPoly &operator=(const TPPLPoly &src);
 
+  // Moving takes over the points of src and leaves it empty. Polygons of
+  // up to NUMINLINEPOINTS points keep them inside the object, so moving
+  // one of those copies its points, without allocating.
+  TPPLPoly(TPPLPoly &&src) noexcept;
+  TPPLPoly &operator=(TPPLPoly &&src) noexcept;
+
   // Getters and setters.
   long GetNumPoints() const {
     return numpoints;
@@ -173,6 +220,103 @@ typedef std::list<TPPLPoly, TPPL_ALLOCATOR(TPPLPoly)> TPPLPolyList;
 typedef std::list<TPPLPoly> TPPLPolyList;
 #endif
 
+// Tells the templated front ends of TPPLPartition how to read the
+// coordinates of a point type. The default works for any type with x and
+// y members; specialize it for point types that store them differently.
+template <class T>
+struct TPPLPointTraits {
+  static tppl_coord GetX(const T &p) {
+    return (tppl_coord)p.x;
+  }
+  static tppl_coord GetY(const T &p) {
+    return (tppl_coord)p.y;
+  }
+};
+
+// Polygon given as numpoints points of type T that start at points and are
+// stride bytes apart, for example the positions of an interleaved vertex
+// buffer. A negative stride reads an array back to front. The points are
+// not copied, so they have to outlive the range.
+template <class T, class Traits = TPPLPointTraits<T> >
+class TPPLPointRange {
+  protected:
+  const unsigned char *points;
+  long numpoints;
+  long stride;
+
+  public:
+  TPPLPointRange(const T *points, long numpoints, long stride = sizeof(T)) :
+          points((const unsigned char *)points), numpoints(numpoints), stride(stride) {}
+
+  long GetNumPoints() const {
+    return numpoints;
+  }
+
+  tppl_coord GetX(long i) const {
+    return Traits::GetX(*(const T *)(points + i * stride));
+  }
+
+  tppl_coord GetY(long i) const {
+    return Traits::GetY(*(const T *)(points + i * stride));
+  }
+};
+
+// Visibility graph of a polygon, telling which pairs of vertices can be
+// joined by a diagonal. Polygon edges count as visible. It is computed by
+// TPPLPartition::ComputeVisibility, and can be passed to both
+// Triangulate_OPT and ConvexPartition_OPT, so that running both on the
+// same polygon computes it only once.
+class TPPLVisibility {
+  friend class TPPLPartition;
+
+  protected:
+  long numpoints;
+  // Bit rowstarts[i] + j of bits tells whether vertices i < j see each
+  // other. Every row starts on a new word.
+  long *rowstarts;
+  uint32_t *bits;
+  long numwords;
+  // Allocated sizes of rowstarts and bits, which Init only ever grows.
+  long rowcapacity;
+  long wordcapacity;
+
+  public:
+  // Constructors and destructors.
+  TPPLVisibility();
+  ~TPPLVisibility();
+
+  TPPLVisibility(const TPPLVisibility &src);
+  TPPLVisibility &operator=(const TPPLVisibility &src);
+
+  // Clears the visibility information.
+  void Clear();
+
+  // Inits the visibility of numpoints vertices, all pairs invisible.
+  void Init(long numpoints);
+
+  long GetNumPoints() const {
+    return numpoints;
+  }
+
+  // Checks whether vertices i and j can see each other.
+  bool IsVisible(long i, long j) const {
+    long bit;
+    if (i > j) {
+      bit = rowstarts[j] + i;
+    } else if (i < j) {
+      bit = rowstarts[i] + j;
+    } else {
+      return false;
+    }
+    return (bits[bit >> 5] >> (bit & 31)) & 1;
+  }
+
+  void SetVisible(long i, long j) {
+    long bit = (i < j) ? (rowstarts[i] + j) : (rowstarts[j] + i);
+    bits[bit >> 5] |= (uint32_t)1 << (bit & 31);
+  }
+};
+
 class TPPLPartition {
   protected:
   struct PartitionVertex {
@@ -188,10 +332,148 @@ class TPPLPartition {
     PartitionVertex();
   };
 
+  // Indexed binary heap of the active ears of a polygon, most extruded
+  // first, used in Triangulate_EC and Triangulate_ECZ.
+  struct EarHeap {
+    // Vertex indices in heap order.
+    long *heap;
+    // Heap position of each vertex, -1 if it isn't an active ear.
+    long *positions;
+    // Angle of each ear, the heap key.
+    tppl_float *angles;
+    long size;
+  };
+
+  // Polygon being clipped by Triangulate_EC, kept as separate arrays so
+  // that the links and flags updated on every clip don't share cache lines
+  // with the coordinates.
+  struct EarPolygon {
+    const TPPLPoint *points;
+    // Coordinates of points again, as scanned by the ear test.
+    const tppl_coord *xs;
+    const tppl_coord *ys;
+    int32_t *previous;
+    int32_t *next;
+    char *active;
+    long numvertices;
+  };
+
+  // Z-order (Morton code) index over the reflex vertices of a polygon
+  // (and the vertices that share a position with another one), used in
+  // Triangulate_ECZ. Entries are sorted by Morton code and only ever
+  // removed, removed entries are skipped through skip.
+  struct ReflexIndex {
+    tppl_float minx;
+    tppl_float miny;
+    tppl_float scale;
+    // (Morton code << 32) | vertex index.
+    uint64_t *entries;
+    // Next entry that may still be live, path-compressed.
+    long *skip;
+    // Entry of each vertex, -1 if the vertex isn't indexed or can't be removed.
+    long *positions;
+    long numentries;
+  };
+
+  // Hole of RemoveHoles_Grid, holes are bridged in order of decreasing
+  // maxx, the x of their right-most vertex.
+  struct HoleEntry {
+    tppl_coord maxx;
+    long poly;
+    // Right-most vertex of the hole, first one if there are several.
+    long vertex;
+
+    bool operator<(const HoleEntry &other) const {
+      if (maxx != other.maxx) {
+        return maxx > other.maxx;
+      }
+      return poly < other.poly;
+    }
+  };
+
+  // Entry of a cell of a HoleGrid.
+  struct HoleGridEntry {
+    // The edge from vertex to next[vertex].
+    long vertex;
+    long next;
+  };
+
+  // Rings of RemoveHoles_Grid, linked by index, and a uniform grid over
+  // the edges of the rings that holes were already bridged into. Bridging
+  // a hole only adds edges, every edge keeps its starting vertex.
+  struct HoleGrid {
+    TPPLPoint *points;
+    long *previous;
+    long *next;
+    // First entry of each cell, -1 for empty cells.
+    long *cells;
+    HoleGridEntry *entries;
+    long numentries;
+    long numcolumns;
+    long numrows;
+    tppl_float minx;
+    tppl_float miny;
+    tppl_float scalex;
+    tppl_float scaley;
+    // Vertices (or their edges) already seen by the current query are
+    // marked with mark.
+    long *marks;
+    long mark;
+  };
+
+  // State of a walk along a segment through a HoleGrid, from its lower
+  // end (x1, y1) to its upper end (x2, y2).
+  struct GridWalk {
+    tppl_float x1;
+    tppl_float y1;
+    tppl_float x2;
+    tppl_float y2;
+    tppl_float dxdy;
+    long firstrow;
+    long lastrow;
+    long row;
+  };
+
+  // Vertex checked in the angular sweep of ComputeVisibility.
+  struct VisibilityQuery {
+    double angle;
+    long vertex;
+
+    bool operator<(const VisibilityQuery &other) const {
+      if (angle != other.angle) {
+        return angle < other.angle;
+      }
+      return vertex < other.vertex;
+    }
+  };
+
+  // Half-edge of the triangles merged by ConvexPartition_HM. Merging two
+  // faces only relinks half-edges, so their endpoints never change.
+  struct HalfEdge {
+    // Polygon vertex the half-edge starts at.
+    long origin;
+    long previous;
+    long next;
+    // Triangle the half-edge started out in.
+    long face;
+    // First half-edge between the same two positions in the opposite
+    // direction, and the next one after this in the same direction.
+    long twin;
+    long nextequal;
+  };
+
   struct MonotoneVertex {
     TPPLPoint p;
     long previous;
     long next;
+    // Position of the vertex in the input polygons.
+    long index;
+  };
+
+  // Sort key of a MonotoneVertex, see SortVertices.
+  struct VertexKey {
+    uint64_t key;
+    long index;
   };
 
   class VertexSorter {
@@ -208,24 +490,30 @@ public:
     long index2;
   };
 
-#ifdef TPPL_ALLOCATOR
-  typedef std::list<Diagonal, TPPL_ALLOCATOR(Diagonal)> DiagonalList;
-#else
-  typedef std::list<Diagonal> DiagonalList;
-#endif
-
-  // Dynamic programming state for minimum-weight triangulation.
-  struct DPState {
-    bool visible;
-    tppl_float weight;
-    long bestvertex;
+  // Diagonal in the list of a DPState2. The nodes of all lists come from
+  // one DiagonalPool and are linked by index, -1 ends a list.
+  struct DiagonalNode {
+    long index1;
+    long index2;
+    long previous;
+    long next;
   };
 
   // Dynamic programming state for convex partitioning.
   struct DPState2 {
     bool visible;
     long weight;
-    DiagonalList pairs;
+    // First and last node of the list of diagonals, -1 if it is empty.
+    long front;
+    long back;
+  };
+
+  // Nodes of the diagonal lists of ConvexPartition_OPT. Removed nodes are
+  // chained through next on freelist and reused.
+  struct DiagonalPool {
+    DiagonalNode *nodes;
+    long numnodes;
+    long freelist;
   };
 
   // Edge that intersects the scanline.
@@ -240,9 +528,482 @@ public:
     bool IsConvex(const TPPLPoint &p1, const TPPLPoint &p2, const TPPLPoint &p3) const;
   };
 
+  // Pool of fixed-size blocks. Freed blocks are kept on a free list per
+  // block size and reused, memory is only returned when the pool is destroyed.
+  class NodePool {
+    struct FreeBlock {
+      FreeBlock *next;
+    };
+
+    struct SizeClass {
+      size_t size;
+      FreeBlock *freelist;
+    };
+
+    SizeClass sizeclasses[4];
+    long numsizeclasses;
+    char *chunks;
+    char *chunkpos;
+    char *chunkend;
+
+public:
+    long numallocations;
+
+    NodePool();
+    ~NodePool();
+
+    // Copies start out empty, pooled memory is never shared.
+    NodePool(const NodePool &) :
+            NodePool() {}
+    NodePool &operator=(const NodePool &) {
+      return *this;
+    }
+
+    void *Allocate(size_t size);
+    void Deallocate(void *p, size_t size);
+  };
+
+  // Standard allocator interface on top of a NodePool.
+  template <class T>
+  class PoolAllocator {
+public:
+    typedef T value_type;
+
+    NodePool *pool;
+
+    PoolAllocator(NodePool *pool) :
+            pool(pool) {}
+    template <class U>
+    PoolAllocator(const PoolAllocator<U> &other) :
+            pool(other.pool) {}
+
+    T *allocate(size_t n) {
+      return (T *)pool->Allocate(n * sizeof(T));
+    }
+    void deallocate(T *p, size_t n) {
+      pool->Deallocate(p, n * sizeof(T));
+    }
+
+    template <class U>
+    bool operator==(const PoolAllocator<U> &other) const {
+      return pool == other.pool;
+    }
+    template <class U>
+    bool operator!=(const PoolAllocator<U> &other) const {
+      return pool != other.pool;
+    }
+  };
+
+#ifdef TPPL_SCANLINE_SKIPLIST
+  // Skip list of the edges intersecting the scanline, with the part of the
+  // std::set interface MonotonePartition uses. Nodes are laid out one after
+  // another in memory sized for one sweep, each followed by its links, so
+  // inserting never allocates. Erased nodes aren't reused.
+  class ScanLineSkipList {
+public:
+    enum {
+      MAXLEVELS = 16
+    };
+
+    struct Node {
+      ScanLineEdge edge;
+      Node *previous;
+      long numlevels;
+      // Next node on each level, numlevels entries.
+      Node *next[1];
+    };
+
+    class iterator {
+      friend class ScanLineSkipList;
+      Node *node;
+
+public:
+      iterator() :
+              node(NULL) {}
+      iterator(Node *node) :
+              node(node) {}
+
+      ScanLineEdge &operator*() const {
+        return node->edge;
+      }
+      ScanLineEdge *operator->() const {
+        return &(node->edge);
+      }
+      iterator &operator--() {
+        node = node->previous;
+        return *this;
+      }
+      iterator operator--(int) {
+        iterator ret = *this;
+        node = node->previous;
+        return ret;
+      }
+      bool operator==(const iterator &other) const {
+        return node == other.node;
+      }
+      bool operator!=(const iterator &other) const {
+        return node != other.node;
+      }
+    };
+
+    // memory has to hold MemorySize(capacity) bytes, suitably aligned.
+    ScanLineSkipList(char *memory, long capacity);
+
+    // Room for the head and capacity nodes of two links on average.
+    static long MemorySize(long capacity) {
+      return (long)(sizeof(Node) + (MAXLEVELS - 1) * sizeof(Node *)) + capacity * (long)(sizeof(Node) + sizeof(Node *));
+    }
+
+    iterator begin();
+    iterator end();
+    std::pair<iterator, bool> insert(const ScanLineEdge &edge);
+    void erase(iterator position);
+    iterator lower_bound(const ScanLineEdge &edge);
+
+protected:
+    // The list ends in NULL links, and the head doubles as end() so that
+    // it can be decremented.
+    Node *head;
+    char *memory;
+    long memoryused;
+    long capacity;
+    long numnodes;
+    long numlevels;
+    uint32_t random;
+
+    // Returns the first node not before edge, NULL if there is none.
+    // Fills update with the last node before edge on each level.
+    Node *Find(const ScanLineEdge &edge, Node **update);
+  };
+
+  typedef ScanLineSkipList ScanLineEdgeTree;
+#else
+  typedef std::set<ScanLineEdge, std::less<ScanLineEdge>, PoolAllocator<ScanLineEdge> > ScanLineEdgeTree;
+#endif
+
+  // Persistent worker threads running a task over chunks of an index
+  // range. Each thread starts on its own share of the chunks and steals
+  // from the back of the others' shares once its own runs out. Workers are
+  // started on first use. Copies get the same number of threads but no
+  // workers of their own yet. Run is not re-entrant, so a task calling it
+  // on the same pool gets the nested range run inline.
+  class ThreadPool {
+    // Remaining chunks of one thread, (first << 32) | end, padded to
+    // a cache line.
+    struct Share {
+      std::atomic<uint64_t> chunks;
+      char padding[56];
+    };
+
+    long numthreads;
+    std::thread *workers;
+    Share *shares;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable finished;
+    long generation;
+    long numbusy;
+    bool stopping;
+
+    // The task being run.
+    void (*function)(void *task, long begin, long end, long thread);
+    void *task;
+    long count;
+    long chunksize;
+
+    // Pool the calling thread is running a task for and its thread index
+    // there, NULL outside of Run.
+    static thread_local ThreadPool *currentpool;
+    static thread_local long currentthread;
+
+    template <class Task>
+    static void Call(void *task, long begin, long end, long thread) {
+      (*(Task *)task)(begin, end, thread);
+    }
+
+    void Start();
+    void Stop();
+    bool Take(long thread, bool steal, long *chunk);
+    void Work(long thread);
+    void WorkerLoop(long thread, long generation);
+
+public:
+    ThreadPool();
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &src);
+    ThreadPool &operator=(const ThreadPool &src);
+
+    // 0 selects one thread per hardware thread.
+    void SetNumThreads(long numthreads);
+    long GetNumThreads() const {
+      return numthreads;
+    }
+
+    // Calls task(begin, end, thread) on chunks of chunksize indices
+    // covering [0, count), and returns once all of them are done. thread
+    // is below GetNumThreads(), 0 being the calling thread.
+    void Run(long count, long chunksize, void (*function)(void *, long, long, long), void *task);
+    template <class Task>
+    void Run(long count, long chunksize, Task &task) {
+      Run(count, chunksize, &Call<Task>, &task);
+    }
+  };
+
+  // Growable array owned by a Workspace. Its contents are not preserved
+  // when it has to grow.
+  template <class T>
+  struct ScratchBuffer {
+    T *data;
+    long size;
+
+    ScratchBuffer() :
+            data(NULL), size(0) {}
+    ~ScratchBuffer() {
+      delete[] data;
+    }
+
+    // Copies start out empty, scratch memory is never shared.
+    ScratchBuffer(const ScratchBuffer &) :
+            ScratchBuffer() {}
+    ScratchBuffer &operator=(const ScratchBuffer &) {
+      return *this;
+    }
+  };
+
+  // Per-thread scratch memory of ComputeVisibility, see ComputeVisibilityRow.
+  struct VisibilityScratch {
+    ScratchBuffer<VisibilityQuery> querybuffer;
+    ScratchBuffer<long> rankbuffer;
+    ScratchBuffer<uint64_t> eventbuffer;
+    ScratchBuffer<long> sortedeventbuffer;
+    ScratchBuffer<long> eventstartbuffer;
+    ScratchBuffer<long> activeedgebuffer;
+    ScratchBuffer<long> activepositionbuffer;
+
+    VisibilityQuery *queries;
+    // Position of each vertex in queries.
+    long *ranks;
+    // (position << 32) | (edge << 1) | end.
+    uint64_t *events;
+    long *sortedevents;
+    long *eventstarts;
+    long *activeedges;
+    long *activepositions;
+  };
+
+  // Per-thread scratch memory of TriangulateMonotone, with room for the
+  // largest piece.
+  struct MonotoneScratch {
+    ScratchBuffer<char> typebuffer;
+    ScratchBuffer<long> prioritybuffer;
+    ScratchBuffer<long> stackbuffer;
+
+    char *vertextypes;
+    long *priority;
+    long *stack;
+  };
+
+  // Scratch memory reused by all calls on this instance. Buffers only ever
+  // grow, so once they fit the largest input no further allocations are made.
+  struct Workspace {
+    long numallocations;
+    NodePool nodepool;
+
+    // Triangulate_EC.
+    ScratchBuffer<int32_t> earprevious;
+    ScratchBuffer<int32_t> earnext;
+    ScratchBuffer<char> earactive;
+    ScratchBuffer<tppl_coord> pointsx;
+    ScratchBuffer<tppl_coord> pointsy;
+    ScratchBuffer<long> earheap;
+    ScratchBuffer<long> earheappositions;
+    ScratchBuffer<tppl_float> earheapangles;
+
+    // Triangulate_ECZ.
+    ScratchBuffer<PartitionVertex> partitionvertices;
+    ScratchBuffer<uint64_t> reflexentries;
+    ScratchBuffer<long> reflexskip;
+    ScratchBuffer<long> reflexpositions;
+
+    // MonotonePartition.
+    ScratchBuffer<MonotoneVertex> monotonevertices;
+    ScratchBuffer<long> priority;
+    ScratchBuffer<VertexKey> vertexkeys;
+    ScratchBuffer<VertexKey> sortedvertexkeys;
+    ScratchBuffer<long> radixcounts;
+    ScratchBuffer<TPPLVertexType> vertextypes;
+    ScratchBuffer<long> helpers;
+    ScratchBuffer<ScanLineEdgeTree::iterator> edgetreeiterators;
+#ifdef TPPL_SCANLINE_SKIPLIST
+    ScratchBuffer<char> scanlinememory;
+#endif
+    ScratchBuffer<char> used;
+    ScratchBuffer<long> pieces;
+    ScratchBuffer<long> piecestarts;
+
+    // TriangulateMonotone.
+    ScratchBuffer<TPPLPoint> piecepoints;
+    ScratchBuffer<long> piecenumtriangles;
+    // One per thread.
+    ScratchBuffer<MonotoneScratch> monotonescratch;
+
+    // ConvexPartition_HM.
+    ScratchBuffer<HalfEdge> halfedges;
+    ScratchBuffer<long> halfedgetable;
+    ScratchBuffer<long> faceparents;
+    ScratchBuffer<long> facestarts;
+    ScratchBuffer<long> facesizes;
+
+    // RemoveHoles_Grid.
+    ScratchBuffer<HoleEntry> holes;
+    ScratchBuffer<long> polystarts;
+    ScratchBuffer<TPPLPoint> ringpoints;
+    ScratchBuffer<long> ringprevious;
+    ScratchBuffer<long> ringnext;
+    ScratchBuffer<long> gridcells;
+    ScratchBuffer<HoleGridEntry> gridentries;
+    ScratchBuffer<long> gridmarks;
+
+    // ClassifyVertices.
+    ScratchBuffer<signed char> orientations;
+
+    // Batch overloads, a single-threaded instance per thread and the
+    // results of the groups.
+    ScratchBuffer<TPPLPartition> batchpartitions;
+    ScratchBuffer<int> batchstatuses;
+
+    // Conversion between TPPLPolyList and indexed input and output, and
+    // the points of a TPPLPointRange in Triangulate_Auto.
+    ScratchBuffer<TPPLPoly *> polys;
+    ScratchBuffer<TPPLPoint> points;
+    ScratchBuffer<uint32_t> indices;
+
+    // ComputeVisibility, one per thread.
+    ScratchBuffer<VisibilityScratch> visibilityscratch;
+
+    // Triangulate_OPT, upper triangular tables of the dynamic program.
+    ScratchBuffer<tppl_float> optweights;
+    ScratchBuffer<int32_t> optbestvertices;
+
+    // ConvexPartition_OPT, states of the dynamic program and the nodes of
+    // their diagonal lists.
+    ScratchBuffer<DPState2 *> dpstaterows;
+    ScratchBuffer<DPState2> dpstates;
+    ScratchBuffer<DiagonalNode> diagonalnodes;
+
+    // Triangulate_OPT and ConvexPartition_OPT, diagonals still to be
+    // recovered, and the vertices of the current part.
+    ScratchBuffer<Diagonal> diagonals;
+    ScratchBuffer<Diagonal> diagonals2;
+    ScratchBuffer<long> partindices;
+
+    // Triangulate_OPT and ConvexPartition_OPT without a given visibility.
+    TPPLVisibility visibility;
+
+    Workspace() :
+            numallocations(0) {}
+    Workspace(const Workspace &) :
+            Workspace() {}
+    Workspace &operator=(const Workspace &) {
+      return *this;
+    }
+
+    // Returns buffer with room for at least size elements.
+    template <class T>
+    T *Get(ScratchBuffer<T> &buffer, long size) {
+      if (size > buffer.size) {
+        delete[] buffer.data;
+        buffer.data = NULL;
+        if (size < 2 * buffer.size) {
+          size = 2 * buffer.size;
+        }
+        buffer.data = new T[size];
+        buffer.size = size;
+        numallocations++;
+      }
+      return buffer.data;
+    }
+
+    // Same as Get, but keeps the first used elements of buffer.
+    template <class T>
+    T *Grow(ScratchBuffer<T> &buffer, long size, long used) {
+      T *data;
+      long i;
+      if (size > buffer.size) {
+        if (size < 2 * buffer.size) {
+          size = 2 * buffer.size;
+        }
+        data = new T[size];
+        for (i = 0; i < used; i++) {
+          data[i] = buffer.data[i];
+        }
+        delete[] buffer.data;
+        buffer.data = data;
+        buffer.size = size;
+        numallocations++;
+      }
+      return buffer.data;
+    }
+  };
+
+  Workspace workspace;
+  ThreadPool threadpool;
+
+  enum {
+    // Triangulate_Auto clips ears of polygons up to this size that it
+    // can't take a fast path for. Above it, Triangulate_MONO is faster.
+    MAXAUTOEARPOINTS = 7
+  };
+
+  // Algorithm the batch overloads run on each group.
+  enum BatchAlgorithm {
+    BATCH_TRIANGULATE_EC,
+    BATCH_TRIANGULATE_MONO,
+    BATCH_CONVEX_PARTITION_HM
+  };
+
+  // Tables of the Triangulate_OPT dynamic program, see Triangulate_OPT.
+  struct OPTTables {
+    long n;
+    tppl_float *weights;
+    int32_t *bestvertices;
+    const TPPLVisibility *visibility;
+  };
+
   // Standard helper functions.
+  // Returns the sign of (p3.y - p1.y) * (p2.x - p1.x) - (p3.x - p1.x) * (p2.y - p1.y),
+  // which is positive if p1, p2, p3 are in counter-clockwise order.
+  static int Orientation(const TPPLPoint &p1, const TPPLPoint &p2, const TPPLPoint &p3);
+#ifdef TPPL_USE_INT32
+  // Exact integer arithmetic behind Orientation.
+  static void Multiply128(uint64_t a, uint64_t b, uint64_t *high, uint64_t *low);
+  static int ProductDifferenceSign(int64_t a, int64_t b, int64_t c, int64_t d);
+#else
+  // Exact fallback of Orientation for the cases its error bound can't decide.
+  static int OrientationExact(const TPPLPoint &p1, const TPPLPoint &p2, const TPPLPoint &p3);
+#endif
   bool IsConvex(TPPLPoint &p1, TPPLPoint &p2, TPPLPoint &p3);
   bool IsReflex(TPPLPoint &p1, TPPLPoint &p2, TPPLPoint &p3);
+
+  // Sets orientations[i] to the Orientation of the previous, the current
+  // and the next vertex, for each vertex i of a polygon of at least three
+  // points that are stride bytes apart.
+  static void ClassifyVertices(const TPPLPoint *points, long stride, long numpoints, signed char *orientations);
+#ifdef TPPL_SIMD
+  // Vectorized parts of ClassifyVertices. They classify the vertices from
+  // 1 on in blocks and return the first vertex left for the scalar code.
+  static bool HasAVX();
+  static long ClassifyVerticesSSE2(const TPPLPoint *points, long stride, long numpoints, signed char *orientations);
+  static long ClassifyVerticesAVX(const TPPLPoint *points, long stride, long numpoints, signed char *orientations);
+
+  // Vectorized parts of AnyPointInside. They return -1 once they find a
+  // point inside, otherwise the first point left for the scalar code.
+  long FindPointInsideSSE2(const TPPLPoint &p1, const TPPLPoint &p2, const TPPLPoint &p3,
+          const double *xs, const double *ys, long numpoints);
+  long FindPointInsideAVX(const TPPLPoint &p1, const TPPLPoint &p2, const TPPLPoint &p3,
+          const double *xs, const double *ys, long numpoints);
+#endif
   bool IsInside(TPPLPoint &p1, TPPLPoint &p2, TPPLPoint &p3, TPPLPoint &p);
 
   bool InCone(TPPLPoint &p1, TPPLPoint &p2, TPPLPoint &p3, TPPLPoint &p);
@@ -250,28 +1011,146 @@ public:
 
   int Intersects(TPPLPoint &p11, TPPLPoint &p12, TPPLPoint &p21, TPPLPoint &p22);
 
-  TPPLPoint Normalize(const TPPLPoint &p);
+  // Cosine of the angle between p1 - p and p2 - p.
+  tppl_float Cosine(const TPPLPoint &p, const TPPLPoint &p1, const TPPLPoint &p2);
   tppl_float Distance(const TPPLPoint &p1, const TPPLPoint &p2);
 
-  // Helper functions for Triangulate_EC.
-  void UpdateVertexReflexity(PartitionVertex *v);
-  void UpdateVertex(PartitionVertex *v, PartitionVertex *vertices, long numvertices);
+  // Helper functions for Triangulate_EC. Both recompute the ear status and
+  // angle of vertex and update its place in heap.
+  void UpdateVertex(EarPolygon *polygon, EarHeap *heap, long vertex);
+  // Same as UpdateVertex, with the convexity of vertex known.
+  void UpdateEar(EarPolygon *polygon, EarHeap *heap, long vertex, bool isconvex);
+
+  // Checks whether any of the numpoints points xs[i], ys[i], other than
+  // the corners themselves, is inside the triangle p1, p2, p3 as by IsInside.
+  bool AnyPointInside(const TPPLPoint &p1, const TPPLPoint &p2, const TPPLPoint &p3,
+          const tppl_coord *xs, const tppl_coord *ys, long numpoints);
+
+  // Helper functions for the ear heap.
+  bool EarBefore(EarHeap *heap, long a, long b);
+  void SiftEarUp(EarHeap *heap, long position);
+  void SiftEarDown(EarHeap *heap, long position);
+  void UpdateEarHeap(EarHeap *heap, long vertex, bool isear, tppl_float angle);
+
+  // Helper functions for Triangulate_ECZ.
+  uint32_t ZOrder(ReflexIndex *index, const TPPLPoint &p);
+  uint32_t ZOrderBigMin(uint32_t z, uint32_t zmin, uint32_t zmax);
+  long NextReflexEntry(ReflexIndex *index, long entry);
+  void RemoveReflexVertex(ReflexIndex *index, long vertex);
+  void UpdateVertexZ(PartitionVertex *v, PartitionVertex *vertices, ReflexIndex *index, bool updateangle);
+  // Triangulate_ECZ on numvertices points, also used in Triangulate_Auto.
+  int TriangulateEarsZ(const TPPLPoint *points, long numvertices, uint32_t *indices, long *numtriangles,
+          bool mostextruded);
+
+  // Helper functions for RemoveHoles_Grid.
+  void GetGridCell(HoleGrid *grid, const TPPLPoint &p, long *column, long *row);
+  void StartGridWalk(HoleGrid *grid, const TPPLPoint &p1, const TPPLPoint &p2, GridWalk *walk);
+  bool WalkGridSegment(HoleGrid *grid, GridWalk *walk, long *row, long *first, long *last);
+  void InsertGridEdge(HoleGrid *grid, long vertex);
+  // Returns whether the bridge from holepoint to the ring vertex crosses
+  // no ring edge, as by Intersects.
+  bool IsBridgeVisible(HoleGrid *grid, TPPLPoint &holepoint, long vertex);
+  // Finds the ring vertex to bridge holepoint to by casting a ray in +x
+  // direction to the nearest ring edge, as in earcut. Returns -1 if that
+  // finds no vertex that is visible and sees holepoint in its cone.
+  long FindHoleBridge(HoleGrid *grid, TPPLPoint &holepoint);
+  // Same as FindHoleBridge, but checks every ring vertex like RemoveHoles.
+  long FindHoleBridgeSlow(HoleGrid *grid, TPPLPoint &holepoint, long numvertices);
+
+  // Helper functions for ConvexPartition_HM.
+  uint64_t HashEdge(const TPPLPoint &p1, const TPPLPoint &p2);
+  long FindFace(long *faceparents, long face);
+
+  // Helper function for ComputeVisibility. Computes which vertices j > i
+  // vertex i sees.
+  void ComputeVisibilityRow(TPPLPoly *poly, TPPLVisibility *visibility, long i, VisibilityScratch *scratch);
+
+  // Helper function for Triangulate_OPT. Finds the best split of the
+  // diagonal (i, j) once all shorter diagonals are done. Returns false if
+  // (i, j) is visible but has no valid split.
+  bool UpdateOPTState(TPPLPoly *poly, OPTTables *tables, long i, long j);
 
   // Helper functions for ConvexPartition_OPT.
-  void UpdateState(long a, long b, long w, long i, long j, DPState2 **dpstates);
-  void TypeA(long i, long j, long k, PartitionVertex *vertices, DPState2 **dpstates);
-  void TypeB(long i, long j, long k, PartitionVertex *vertices, DPState2 **dpstates);
+  void UpdateState(long a, long b, long w, long i, long j, DPState2 **dpstates, DiagonalPool *pool);
+  void TypeA(long i, long j, long k, PartitionVertex *vertices, DPState2 **dpstates, DiagonalPool *pool);
+  void TypeB(long i, long j, long k, PartitionVertex *vertices, DPState2 **dpstates, DiagonalPool *pool);
+
+  // Diagonal list operations for ConvexPartition_OPT.
+  void PushFrontDiagonal(DPState2 *state, DiagonalPool *pool, long index1, long index2);
+  void PopFrontDiagonal(DPState2 *state, DiagonalPool *pool);
+  void PopBackDiagonal(DPState2 *state, DiagonalPool *pool);
+  void ClearDiagonals(DPState2 *state, DiagonalPool *pool);
 
   // Helper functions for MonotonePartition.
   bool Below(TPPLPoint &p1, TPPLPoint &p2);
   void AddDiagonal(MonotoneVertex *vertices, long *numvertices, long index1, long index2,
-          TPPLVertexType *vertextypes, std::set<ScanLineEdge>::iterator *edgeTreeIterators,
-          std::set<ScanLineEdge> *edgeTree, long *helpers);
+          TPPLVertexType *vertextypes, ScanLineEdgeTree::iterator *edgeTreeIterators,
+          ScanLineEdgeTree *edgeTree, long *helpers);
+  uint64_t SortKey(tppl_coord value);
+  void SortVertices(MonotoneVertex *vertices, long *priority, long numvertices);
+
+  // Creates a monotone partition of numpolys polygons in the workspace.
+  // The pieces are runs of indices into workspace.monotonevertices, piece i
+  // occupying pieces[piecestarts[i]] to pieces[piecestarts[i + 1] - 1].
+  int MonotonePartition(TPPLPoly **polys, long numpolys, long *numpieces);
 
   // Triangulates a monotone polygon, used in Triangulate_MONO.
-  int TriangulateMonotone(TPPLPoly *inPoly, TPPLPolyList *triangles);
+  // pointindices holds the input position of each of the numpoints points.
+  int TriangulateMonotone(TPPLPoint *points, long *pointindices, long numpoints, uint32_t *indices, long *numtriangles,
+          MonotoneScratch *scratch);
+
+  // Same as above, for numvertices vertices already linked into polygons
+  // at the start of workspace.monotonevertices, which has to have room
+  // for 3 * numvertices.
+  int MonotonePartition(long numvertices, long *numpieces);
+
+  // Triangulates numpolys polygons that can contain holes, used in Triangulate_MONO.
+  int Triangulate_MONO(TPPLPoly **polys, long numpolys, uint32_t *indices, long *numtriangles);
+
+  // Triangulates the pieces of MonotonePartition, failing if they would
+  // give more than maxnumtriangles triangles. The pieces are spread over
+  // the threads set with SetNumThreads, each writing its own part of
+  // indices.
+  int TriangulateMonotonePieces(long numpieces, long maxnumtriangles, uint32_t *indices, long *numtriangles);
+
+  // Helper functions for Triangulate_Auto.
+  // Checks whether a polygon with the given vertex orientations, as by
+  // ClassifyVertices, is strictly convex.
+  bool IsConvexPolygon(const TPPLPoint *points, long numpoints, const signed char *orientations);
+  // Triangulates numpoints points, at least 3, on every path but the one
+  // to Triangulate_MONO. Returns 1 on success, 0 on failure and -1 if the
+  // polygon has to go to Triangulate_MONO, with nothing written.
+  int TriangulateAuto(TPPLPoint *points, long numpoints, uint32_t *indices, long *numtriangles);
+
+  // Helper function for the batch overloads. Runs algorithm on each of
+  // the groups on the thread pool, every thread with its own
+  // single-threaded instance from batchpartitions, so the instances never
+  // call back into the thread pool while it runs the batch.
+  int RunBatch(BatchAlgorithm algorithm, TPPLPolyList *groups, long numgroups, TPPLPolyList *results, int *statuses);
+
+  // Appends an index triple to indices.
+  void AddTriangle(uint32_t *indices, long *numtriangles, long i1, long i2, long i3);
+
+  // Converts index triples referring to points into triangles.
+  void AddTriangles(TPPLPoint *points, uint32_t *indices, long numtriangles, TPPLPolyList *triangles);
 
   public:
+  // Returns the number of heap allocations this instance has made for
+  // scratch memory. Scratch memory is kept between calls, so once it has
+  // grown to fit the largest input, no call changes this count. The indexed
+  // overloads of Triangulate_EC, Triangulate_MONO and Triangulate_OPT then
+  // make no heap allocations at all, the other overloads only for their
+  // output.
+  long GetAllocationCount() const;
+
+  // Sets the number of threads used by the algorithms that can run in
+  // parallel (currently Triangulate_OPT, the triangulation of the monotone
+  // pieces in Triangulate_MONO and the batch overloads). 0 selects one per
+  // hardware thread. The default is 1. Results don't depend on the thread
+  // count.
+  void SetNumThreads(long numthreads);
+  long GetNumThreads() const;
+
   // Simple heuristic procedure for removing holes from a list of polygons.
   // It works by creating a diagonal from the right-most hole vertex
   // to some other visible vertex.
@@ -287,6 +1166,24 @@ public:
   // Returns 1 on success, 0 on failure.
   int RemoveHoles(TPPLPolyList *inpolys, TPPLPolyList *outpolys);
 
+  // Removes holes like RemoveHoles, but sorts the holes once and finds
+  // each bridge by casting a ray to the nearest edge (as in earcut), with
+  // a uniform grid over the edges for the ray and the visibility tests.
+  // Holes are spliced into linked rings instead of copying the polygon
+  // for each hole. The bridges can differ from the ones of RemoveHoles.
+  // Time complexity: O(n + h*log(h)) for typical input, O(h*(n^2)) worst
+  // case, h is the # of holes, n is the # of vertices.
+  // Space complexity: O(n)
+  // params:
+  //    inpolys:
+  //       A list of polygons that can contain holes.
+  //       Vertices of all non-hole polys have to be in counter-clockwise order.
+  //       Vertices of all hole polys have to be in clockwise order.
+  //    outpolys:
+  //       A list of polygons without holes.
+  // Returns 1 on success, 0 on failure.
+  int RemoveHoles_Grid(TPPLPolyList *inpolys, TPPLPolyList *outpolys);
+
   // Triangulates a polygon by ear clipping.
   // Time complexity: O(n^2), n is the number of vertices.
   // Space complexity: O(n)
@@ -299,10 +1196,50 @@ public:
   // Returns 1 on success, 0 on failure.
   int Triangulate_EC(TPPLPoly *poly, TPPLPolyList *triangles);
 
+  // Triangulates a polygon by ear clipping and writes the result
+  // as triples of vertex indices instead of triangles.
+  // Time complexity: O(n^2), n is the number of vertices.
+  // Space complexity: O(n)
+  // params:
+  //    poly:
+  //       An input polygon to be triangulated.
+  //       Vertices have to be in counter-clockwise order.
+  //    indices:
+  //       Caller-provided buffer of at least 3 * (n - 2) entries. Each index
+  //       refers to a vertex position in poly (result).
+  //    numtriangles:
+  //       Number of index triples written to indices (result).
+  // Returns 1 on success, 0 on failure.
+  int Triangulate_EC(TPPLPoly *poly, uint32_t *indices, long *numtriangles);
+
+  // Triangulates a polygon by ear clipping, testing candidate ears only
+  // against reflex vertices, which are looked up through a z-order index
+  // over the polygon's bounding box. By default, ears are clipped as they
+  // are found. If mostextruded is set, the most extruded ear is clipped
+  // first, as in Triangulate_EC, which gives better shaped triangles.
+  // Time complexity: O(n*log(n)) for typical input, O(n^2) worst case,
+  // n is the number of vertices.
+  // Space complexity: O(n)
+  // params:
+  //    poly:
+  //       An input polygon to be triangulated.
+  //       Vertices have to be in counter-clockwise order.
+  //    triangles:
+  //       A list of triangles (result).
+  //    mostextruded:
+  //       Whether to clip the most extruded ear first.
+  // Returns 1 on success, 0 on failure.
+  int Triangulate_ECZ(TPPLPoly *poly, TPPLPolyList *triangles, bool mostextruded = false);
+
+  // Same as above, but writes the result as triples of vertex indices
+  // into a caller-provided buffer of at least 3 * (n - 2) entries.
+  int Triangulate_ECZ(TPPLPoly *poly, uint32_t *indices, long *numtriangles, bool mostextruded = false);
+
   // Triangulates a list of polygons that may contain holes by ear clipping
-  // algorithm. It first calls RemoveHoles to get rid of the holes, and then
-  // calls Triangulate_EC for each resulting polygon.
-  // Time complexity: O(h*(n^2)), h is the # of holes, n is the # of vertices.
+  // algorithm. It first calls RemoveHoles_Grid to get rid of the holes, and
+  // then calls Triangulate_EC for each resulting polygon.
+  // Time complexity: O(n^2), n is the # of vertices, plus that of
+  // RemoveHoles_Grid.
   // Space complexity: O(n)
   // params:
   //    inpolys:
@@ -314,6 +1251,47 @@ public:
   // Returns 1 on success, 0 on failure.
   int Triangulate_EC(TPPLPolyList *inpolys, TPPLPolyList *triangles);
 
+  // Runs the overload above on each of numgroups independent groups of
+  // polygons, spread over the threads set with SetNumThreads. Idle
+  // threads steal groups from busy ones. The output doesn't depend on the
+  // thread count. If TPPL_ALLOCATOR is set, it has to be thread-safe.
+  // Time complexity: that of the overload above, summed over the groups
+  // and shared by the threads.
+  // Space complexity: that of the overload above for the largest group,
+  // per thread.
+  // params:
+  //    groups:
+  //       Array of numgroups lists of polygons, each one as for the
+  //       overload above, for example a polygon with its holes.
+  //    triangles:
+  //       Array of numgroups lists, triangles[i] receives the triangles of
+  //       groups[i] (result).
+  //    statuses:
+  //       Array of numgroups entries, statuses[i] receives what the
+  //       overload above returned for groups[i] (result). Can be NULL.
+  // Returns 1 if all groups succeed, 0 otherwise.
+  int Triangulate_EC(TPPLPolyList *groups, long numgroups, TPPLPolyList *triangles, int *statuses = NULL);
+
+  // Computes which pairs of vertices of a polygon can be joined by
+  // a diagonal, by an angular sweep around each vertex. The sweep keeps
+  // the edges whose angular range, widened by 1e-9 radians, contains the
+  // current direction, plus the edges in line with the vertex, and checks
+  // each vertex against all of them rather than only the nearest one.
+  // The sweeps run on the threads set with SetNumThreads.
+  // Time complexity: O((n^2)*log(n) + n*m), n is the number of vertices
+  // and m the number of edges active at a vertex, summed over the sweep.
+  // This is O((n^2)*log(n)) when few edges overlap as seen from a vertex,
+  // but O(n^3) worst case, such as for spirals or many vertices in line.
+  // Space complexity: O(n^2)
+  // params:
+  //    poly:
+  //       An input polygon.
+  //       Vertices have to be in counter-clockwise order.
+  //    visibility:
+  //       Visibility of the vertices of poly (result).
+  // Returns 1 on success, 0 on failure.
+  int ComputeVisibility(TPPLPoly *poly, TPPLVisibility *visibility);
+
   // Creates an optimal polygon triangulation in terms of minimal edge length.
   // Time complexity: O(n^3), n is the number of vertices
   // Space complexity: O(n^2)
@@ -326,6 +1304,27 @@ public:
   // Returns 1 on success, 0 on failure.
   int Triangulate_OPT(TPPLPoly *poly, TPPLPolyList *triangles);
 
+  // Same as above, but with the visibility of the vertices of poly given,
+  // as computed by ComputeVisibility.
+  int Triangulate_OPT(TPPLPoly *poly, const TPPLVisibility *visibility, TPPLPolyList *triangles);
+
+  // Creates an optimal polygon triangulation in terms of minimal edge length
+  // and writes the result as triples of vertex indices instead of triangles.
+  // Time complexity: O(n^3), n is the number of vertices
+  // Space complexity: O(n^2)
+  // params:
+  //    poly:
+  //       An input polygon to be triangulated.
+  //       Vertices have to be in counter-clockwise order.
+  //    indices:
+  //       Caller-provided buffer of at least 3 * (n - 2) entries. Each index
+  //       refers to a vertex position in poly (result).
+  //    numtriangles:
+  //       Number of index triples written to indices (result).
+  // Returns 1 on success, 0 on failure.
+  int Triangulate_OPT(TPPLPoly *poly, uint32_t *indices, long *numtriangles);
+  int Triangulate_OPT(TPPLPoly *poly, const TPPLVisibility *visibility, uint32_t *indices, long *numtriangles);
+
   // Triangulates a polygon by first partitioning it into monotone polygons.
   // Time complexity: O(n*log(n)), n is the number of vertices.
   // Space complexity: O(n)
@@ -338,8 +1337,47 @@ public:
   // Returns 1 on success, 0 on failure.
   int Triangulate_MONO(TPPLPoly *poly, TPPLPolyList *triangles);
 
+  // Triangulates a polygon by first partitioning it into monotone polygons
+  // and writes the result as triples of vertex indices instead of triangles.
+  // Time complexity: O(n*log(n)), n is the number of vertices.
+  // Space complexity: O(n)
+  // params:
+  //    poly:
+  //       An input polygon to be triangulated.
+  //       Vertices have to be in counter-clockwise order.
+  //    indices:
+  //       Caller-provided buffer of at least 3 * (n - 2) entries. Each index
+  //       refers to a vertex position in poly (result).
+  //    numtriangles:
+  //       Number of index triples written to indices (result).
+  // Returns 1 on success, 0 on failure.
+  int Triangulate_MONO(TPPLPoly *poly, uint32_t *indices, long *numtriangles);
+
+  // Same as above, but reads the polygon straight from caller memory
+  // through a TPPLPointRange instead of a TPPLPoly.
+  // params:
+  //    points:
+  //       An input polygon to be triangulated.
+  //       Vertices have to be in counter-clockwise order.
+  //    indices:
+  //       Caller-provided buffer of at least 3 * (n - 2) entries. Each index
+  //       refers to a vertex position in points (result).
+  //    numtriangles:
+  //       Number of index triples written to indices (result).
+  // Returns 1 on success, 0 on failure.
+  template <class T, class Traits>
+  int Triangulate_MONO(const TPPLPointRange<T, Traits> &points, uint32_t *indices, long *numtriangles);
+
+  // Same as above, for numpoints points stored contiguously.
+  template <class T>
+  int Triangulate_MONO(const T *points, long numpoints, uint32_t *indices, long *numtriangles) {
+    return Triangulate_MONO(TPPLPointRange<T>(points, numpoints), indices, numtriangles);
+  }
+
   // Triangulates a list of polygons by first
   // partitioning them into monotone polygons.
+  // The monotone polygons are triangulated on the threads set with
+  // SetNumThreads.
   // Time complexity: O(n*log(n)), n is the number of vertices.
   // Space complexity: O(n)
   // params:
@@ -349,9 +1387,113 @@ public:
   //       Vertices of all hole polys have to be in clockwise order.
   //    triangles:
   //       A list of triangles (result).
-  // Returns 1 on success, 0 on failure.
+  // Returns 1 on success, 0 on failure. Also fails if the partition would
+  // give more than n + 2 * h - 2 triangles, h being the # of holes, as it
+  // can for holes that are not inside the outer polygon.
   int Triangulate_MONO(TPPLPolyList *inpolys, TPPLPolyList *triangles);
 
+  // Runs the overload above on each of numgroups independent groups of
+  // polygons, spread over the threads set with SetNumThreads. Idle
+  // threads steal groups from busy ones. The output doesn't depend on the
+  // thread count. If TPPL_ALLOCATOR is set, it has to be thread-safe.
+  // Time complexity: that of the overload above, summed over the groups
+  // and shared by the threads.
+  // Space complexity: that of the overload above for the largest group,
+  // per thread.
+  // params:
+  //    groups:
+  //       Array of numgroups lists of polygons, each one as for the
+  //       overload above, for example a polygon with its holes.
+  //    triangles:
+  //       Array of numgroups lists, triangles[i] receives the triangles of
+  //       groups[i] (result).
+  //    statuses:
+  //       Array of numgroups entries, statuses[i] receives what the
+  //       overload above returned for groups[i] (result). Can be NULL.
+  // Returns 1 if all groups succeed, 0 otherwise.
+  int Triangulate_MONO(TPPLPolyList *groups, long numgroups, TPPLPolyList *triangles, int *statuses = NULL);
+
+  // Triangulates a list of polygons by first partitioning them into
+  // monotone polygons and writes the result as triples of vertex indices.
+  // Time complexity: O(n*log(n)), n is the number of vertices.
+  // Space complexity: O(n)
+  // params:
+  //    inpolys:
+  //       A list of polygons to be triangulated (can contain holes).
+  //       Vertices of all non-hole polys have to be in counter-clockwise order.
+  //       Vertices of all hole polys have to be in clockwise order.
+  //    indices:
+  //       Caller-provided buffer of at least 3 * (n + 2 * h - 2) entries,
+  //       h is the # of holes. Each index refers to a vertex position in the
+  //       concatenation of all polygons in inpolys, in list order (result).
+  //    numtriangles:
+  //       Number of index triples written to indices (result).
+  // Returns 1 on success, 0 on failure, including when the triangles would
+  // not fit in the buffer above.
+  int Triangulate_MONO(TPPLPolyList *inpolys, uint32_t *indices, long *numtriangles);
+
+  // Triangulates a polygon with the fastest algorithm for it. One linear
+  // pass classifies the vertices. Convex polygons are triangulated as
+  // a fan from the first vertex, y-monotone ones directly as by the second
+  // phase of Triangulate_MONO. Other polygons go to Triangulate_ECZ if
+  // they are small, and to Triangulate_MONO otherwise, so the triangles
+  // depend on the path taken.
+  // Time complexity: O(n) for convex and monotone polygons, O(n*log(n))
+  // otherwise, n is the number of vertices.
+  // Space complexity: O(n)
+  // params:
+  //    poly:
+  //       An input polygon to be triangulated.
+  //       Vertices have to be in counter-clockwise order.
+  //    triangles:
+  //       A list of triangles (result).
+  // Returns 1 on success, 0 on failure.
+  int Triangulate_Auto(TPPLPoly *poly, TPPLPolyList *triangles);
+
+  // Same as above, but writes the result as triples of vertex indices.
+  // params:
+  //    indices:
+  //       Caller-provided buffer of at least 3 * (n - 2) entries (result).
+  //    numtriangles:
+  //       Number of index triples written to indices (result).
+  int Triangulate_Auto(TPPLPoly *poly, uint32_t *indices, long *numtriangles);
+
+  // Same as above, but reads the polygon from caller memory through
+  // a TPPLPointRange instead of a TPPLPoly. Unlike Triangulate_MONO, this
+  // first copies the points into the workspace of the partition, as the
+  // convex, monotone and ear clipping paths work on packed TPPLPoints.
+  // The copy is O(n) and only allocates when the workspace grows.
+  // params:
+  //    points:
+  //       An input polygon to be triangulated.
+  //       Vertices have to be in counter-clockwise order.
+  //    indices:
+  //       Caller-provided buffer of at least 3 * (n - 2) entries. Each index
+  //       refers to a vertex position in points (result).
+  //    numtriangles:
+  //       Number of index triples written to indices (result).
+  // Returns 1 on success, 0 on failure.
+  template <class T, class Traits>
+  int Triangulate_Auto(const TPPLPointRange<T, Traits> &points, uint32_t *indices, long *numtriangles);
+
+  // Same as above, for numpoints points stored contiguously.
+  template <class T>
+  int Triangulate_Auto(const T *points, long numpoints, uint32_t *indices, long *numtriangles) {
+    return Triangulate_Auto(TPPLPointRange<T>(points, numpoints), indices, numtriangles);
+  }
+
+  // Triangulates a list of polygons with Triangulate_Auto, or with
+  // Triangulate_MONO if there are holes.
+  // params:
+  //    inpolys:
+  //       A list of polygons to be triangulated (can contain holes).
+  //       Vertices of all non-hole polys have to be in counter-clockwise order.
+  //       Vertices of all hole polys have to be in clockwise order.
+  //    triangles:
+  //       A list of triangles (result).
+  // Returns 1 on success, 0 on failure.
+  int Triangulate_Auto(TPPLPolyList *inpolys, TPPLPolyList *triangles);
+
   // Creates a monotone partition of a list of polygons that
   // can contain holes. Triangulates a set of polygons by
   // first partitioning them into monotone polygons.
@@ -371,7 +1513,8 @@ public:
   // Hertel-Mehlhorn algorithm. The algorithm gives at most four times
   // the number of parts as the optimal algorithm, however, in practice
   // it works much better than that and often gives optimal partition.
-  // It uses triangulation obtained by ear clipping as intermediate result.
+  // It uses triangulation obtained by ear clipping as intermediate result,
+  // the merging of its triangles takes linear time.
   // Time complexity O(n^2), n is the number of vertices.
   // Space complexity: O(n)
   // params:
@@ -387,8 +1530,10 @@ public:
   // Hertel-Mehlhorn algorithm. The algorithm gives at most four times
   // the number of parts as the optimal algorithm, however, in practice
   // it works much better than that and often gives optimal partition.
-  // It uses triangulation obtained by ear clipping as intermediate result.
-  // Time complexity O(n^2), n is the number of vertices.
+  // It uses triangulation obtained by ear clipping as intermediate result,
+  // after removing the holes with RemoveHoles_Grid.
+  // Time complexity O(n^2), n is the number of vertices, plus that of
+  // RemoveHoles_Grid.
   // Space complexity: O(n)
   // params:
   //    inpolys:
@@ -400,6 +1545,27 @@ public:
   // Returns 1 on success, 0 on failure.
   int ConvexPartition_HM(TPPLPolyList *inpolys, TPPLPolyList *parts);
 
+  // Runs the overload above on each of numgroups independent groups of
+  // polygons, spread over the threads set with SetNumThreads. Idle
+  // threads steal groups from busy ones. The output doesn't depend on the
+  // thread count. If TPPL_ALLOCATOR is set, it has to be thread-safe.
+  // Time complexity: that of the overload above, summed over the groups
+  // and shared by the threads.
+  // Space complexity: that of the overload above for the largest group,
+  // per thread.
+  // params:
+  //    groups:
+  //       Array of numgroups lists of polygons, each one as for the
+  //       overload above, for example a polygon with its holes.
+  //    parts:
+  //       Array of numgroups lists, parts[i] receives the convex parts of
+  //       groups[i] (result).
+  //    statuses:
+  //       Array of numgroups entries, statuses[i] receives what the
+  //       overload above returned for groups[i] (result). Can be NULL.
+  // Returns 1 if all groups succeed, 0 otherwise.
+  int ConvexPartition_HM(TPPLPolyList *groups, long numgroups, TPPLPolyList *parts, int *statuses = NULL);
+
   // Optimal convex partitioning (in terms of number of resulting
   // convex polygons) using the Keil-Snoeyink algorithm.
   // For reference, see M. Keil, J. Snoeyink, "On the time bound for
@@ -414,6 +1580,65 @@ public:
   //       Resulting list of convex polygons.
   // Returns 1 on success, 0 on failure.
   int ConvexPartition_OPT(TPPLPoly *poly, TPPLPolyList *parts);
+
+  // Same as above, but with the visibility of the vertices of poly given,
+  // as computed by ComputeVisibility.
+  int ConvexPartition_OPT(TPPLPoly *poly, const TPPLVisibility *visibility, TPPLPolyList *parts);
 };
 
+template <class T, class Traits>
+int TPPLPartition::Triangulate_MONO(const TPPLPointRange<T, Traits> &points, uint32_t *indices, long *numtriangles) {
+  MonotoneVertex *vertices = NULL;
+  long i, numpoints, numpieces;
+
+  *numtriangles = 0;
+  numpoints = points.GetNumPoints();
+  if (numpoints < 3) {
+    return 0;
+  }
+
+  // The coordinates go straight into the vertices of the sweep.
+  vertices = workspace.Get(workspace.monotonevertices, numpoints * 3);
+  for (i = 0; i < numpoints; i++) {
+    vertices[i].p.x = points.GetX(i);
+    vertices[i].p.y = points.GetY(i);
+    vertices[i].p.id = (int)i;
+    vertices[i].index = i;
+    vertices[i].previous = (i == 0) ? (numpoints - 1) : (i - 1);
+    vertices[i].next = (i == numpoints - 1) ? 0 : (i + 1);
+  }
+
+  if (!MonotonePartition(numpoints, &numpieces)) {
+    return 0;
+  }
+  return TriangulateMonotonePieces(numpieces, numpoints - 2, indices, numtriangles);
+}
+
+template <class T, class Traits>
+int TPPLPartition::Triangulate_Auto(const TPPLPointRange<T, Traits> &points, uint32_t *indices, long *numtriangles) {
+  TPPLPoint *copy = NULL;
+  long i, numpoints;
+  int ret;
+
+  *numtriangles = 0;
+  numpoints = points.GetNumPoints();
+  if (numpoints < 3) {
+    return 0;
+  }
+
+  // The fast paths work on a packed copy in the workspace; Triangulate_MONO
+  // reads the range itself.
+  copy = workspace.Get(workspace.points, numpoints);
+  for (i = 0; i < numpoints; i++) {
+    copy[i].x = points.GetX(i);
+    copy[i].y = points.GetY(i);
+    copy[i].id = (int)i;
+  }
+  ret = TriangulateAuto(copy, numpoints, indices, numtriangles);
+  if (ret >= 0) {
+    return ret;
+  }
+  return Triangulate_MONO(points, indices, numtriangles);
+}
+
 #endif
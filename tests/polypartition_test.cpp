@@ -0,0 +1,1233 @@
+// Regression tests for polypartition. Running make in this directory builds
+// and runs them once per coordinate mode and once with the skip list
+// scanline, see the Makefile. A single build is just
+//   g++ -std=c++11 -pthread -I.. polypartition_test.cpp ../polypartition.cpp -o polypartition_test
+// The program returns 0 if all tests pass.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "polypartition.h"
+
+static int numfailures = 0;
+
+// Every heap allocation of the program, the library's included.
+static std::atomic<long> numheapallocations(0);
+
+void *operator new(size_t size) {
+  void *p;
+  numheapallocations++;
+  p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+#define CHECK(condition)                                                   \
+  do {                                                                     \
+    if (!(condition)) {                                                    \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      numfailures++;                                                       \
+    }                                                                      \
+  } while (0)
+
+// Exposes protected helpers of TPPLPartition to the tests.
+class TestPartition : public TPPLPartition {
+  public:
+  using TPPLPartition::Orientation;
+#ifndef TPPL_USE_INT32
+  using TPPLPartition::OrientationExact;
+#endif
+#ifdef TPPL_SIMD
+  using TPPLPartition::HasAVX;
+  using TPPLPartition::ClassifyVerticesSSE2;
+  using TPPLPartition::ClassifyVerticesAVX;
+  using TPPLPartition::FindPointInsideSSE2;
+  using TPPLPartition::FindPointInsideAVX;
+#endif
+  using TPPLPartition::IsInside;
+  using TPPLPartition::InCone;
+  using TPPLPartition::Intersects;
+  using TPPLPartition::MonotoneVertex;
+  using TPPLPartition::VertexSorter;
+  using TPPLPartition::SortVertices;
+#ifdef TPPL_USE_INT32
+  using TPPLPartition::ProductDifferenceSign;
+#endif
+};
+
+// Makes a polygon from numpoints x, y pairs.
+static TPPLPoly MakePoly(const tppl_coord *coords, long numpoints, bool hole) {
+  TPPLPoly poly;
+  long i;
+
+  poly.Init(numpoints);
+  for (i = 0; i < numpoints; i++) {
+    poly[i].x = coords[2 * i];
+    poly[i].y = coords[2 * i + 1];
+    poly[i].id = (int)i;
+  }
+  poly.SetHole(hole);
+  return poly;
+}
+
+// A hole crossing the boundary of the outer polygon makes the monotone
+// partition come out with more than n + 2 * h - 2 triangles. Those would
+// overrun the caller's index buffer, so Triangulate_MONO fails instead of
+// returning them as the original implementation did.
+static void TestMonoHoleOutsideOuter() {
+  static const tppl_coord outer[] = {
+    39, 4, 34, 40, 1, 31, -31, 48, -25, 13, -42, -3, -31, -37, -2, -65, 13, -20, 34, -21
+  };
+  static const tppl_coord hole[] = {
+    59, -34, 53, -40, 28, -35, 37, -17, 57, -17
+  };
+  TPPLPartition pp;
+  TPPLPolyList polys, triangles;
+  std::vector<uint32_t> indices(3 * (10 + 5 + 2 * 1 - 2));
+  long numtriangles;
+
+  polys.push_back(MakePoly(outer, 10, false));
+  polys.push_back(MakePoly(hole, 5, true));
+
+  CHECK(pp.Triangulate_MONO(&polys, &indices[0], &numtriangles) == 0);
+  CHECK(pp.Triangulate_MONO(&polys, &triangles) == 0);
+  CHECK(triangles.empty());
+}
+
+// Star with alternating outer and inner radii. Every inner vertex is a
+// split or merge vertex, so the monotone partition has about n / 2 pieces.
+static TPPLPoly MakeSpikyStar(long numpoints) {
+  TPPLPoly poly;
+  tppl_float angle, radius;
+  long i;
+
+  poly.Init(numpoints);
+  for (i = 0; i < numpoints; i++) {
+    angle = (tppl_float)(2 * 3.14159265358979323846 * i / numpoints);
+    radius = (i % 2) ? 4000 : 10000;
+    poly[i].x = (tppl_coord)floor(radius * cos(angle));
+    poly[i].y = (tppl_coord)floor(radius * sin(angle) + 0.5 * (i % 7));
+    poly[i].id = (int)i;
+  }
+  return poly;
+}
+
+// Polygon with numpoints vertices at increasing angles around the origin
+// and random distances between minradius and radius, rounded to integers.
+// The angles are spread out enough for the rounding to keep it simple.
+static TPPLPoly MakeRandomStar(std::mt19937 &rng, long numpoints, double minradius, double radius) {
+  std::uniform_real_distribution<double> uniform(0, 1);
+  TPPLPoly poly;
+  double angle, r;
+  long i;
+
+  poly.Init(numpoints);
+  for (i = 0; i < numpoints; i++) {
+    angle = 2 * 3.14159265358979323846 * (i + 0.5 * uniform(rng)) / numpoints;
+    r = minradius + (radius - minradius) * uniform(rng);
+    poly[i].x = (tppl_coord)floor(r * cos(angle) + 0.5);
+    poly[i].y = (tppl_coord)floor(r * sin(angle) + 0.5);
+    poly[i].id = (int)i;
+  }
+  return poly;
+}
+
+// Twice the signed area of a triangle or a polygon, exact for the integer
+// coordinates used here.
+static double TwiceArea(const TPPLPoint &p1, const TPPLPoint &p2, const TPPLPoint &p3) {
+  return ((double)p2.x - p1.x) * ((double)p3.y - p1.y) - ((double)p3.x - p1.x) * ((double)p2.y - p1.y);
+}
+
+static double TwiceArea(const TPPLPoly &poly) {
+  double area;
+  long i;
+
+  area = 0;
+  for (i = 1; i + 1 < poly.GetNumPoints(); i++) {
+    area += TwiceArea(poly[0], poly[(int)i], poly[(int)i + 1]);
+  }
+  return area;
+}
+
+// Random star polygon of numpoints vertices with up to three random star
+// holes of numholepoints vertices, in polys. Returns twice the area left.
+static double MakeStarWithHoles(std::mt19937 &rng, long numpoints, long numholes, long numholepoints, TPPLPolyList *polys) {
+  TPPLPoly hole;
+  long i, j;
+  double area;
+
+  polys->clear();
+  polys->push_back(MakeRandomStar(rng, numpoints, 8000, 10000));
+  area = TwiceArea(polys->front());
+  for (i = 0; i < numholes; i++) {
+    hole = MakeRandomStar(rng, numholepoints, 500, 1500);
+    for (j = 0; j < hole.GetNumPoints(); j++) {
+      hole[(int)j].x += (tppl_coord)floor(4000 * cos(2.1 * i));
+      hole[(int)j].y += (tppl_coord)floor(4000 * sin(2.1 * i));
+    }
+    area -= TwiceArea(hole);
+    hole.Invert();
+    hole.SetHole(true);
+    polys->push_back(hole);
+  }
+  return area;
+}
+
+// Checks that the numtriangles index triples are n - 2 counter-clockwise
+// triangles of poly whose areas add up to twice area.
+static bool IsTriangulation(const TPPLPoly &poly, double area, const uint32_t *indices, long numtriangles) {
+  double sum, trianglearea;
+  long i;
+
+  if (numtriangles != poly.GetNumPoints() - 2) {
+    return false;
+  }
+  sum = 0;
+  for (i = 0; i < numtriangles; i++) {
+    if ((indices[3 * i] >= (uint32_t)poly.GetNumPoints()) || (indices[3 * i + 1] >= (uint32_t)poly.GetNumPoints()) ||
+            (indices[3 * i + 2] >= (uint32_t)poly.GetNumPoints())) {
+      return false;
+    }
+    trianglearea = TwiceArea(poly[indices[3 * i]], poly[indices[3 * i + 1]], poly[indices[3 * i + 2]]);
+    if (trianglearea < 0) {
+      return false;
+    }
+    sum += trianglearea;
+  }
+  return sum == area;
+}
+
+static bool SameTriangles(TPPLPolyList *a, TPPLPolyList *b) {
+  TPPLPolyList::iterator itera, iterb;
+  long i;
+
+  if (a->size() != b->size()) {
+    return false;
+  }
+  for (itera = a->begin(), iterb = b->begin(); itera != a->end(); itera++, iterb++) {
+    for (i = 0; i < 3; i++) {
+      if (itera->GetPoint(i) != iterb->GetPoint(i)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// The monotone pieces of a group with more than 64 of them are spread
+// over the thread pool. In a batch, that must not disturb the run of the
+// batch itself.
+static void TestMonoBatchMatchesSerial() {
+  const long numgroups = 40;
+  std::vector<TPPLPolyList> groups(numgroups), serial(numgroups), batch(numgroups);
+  std::vector<int> serialstatuses(numgroups), statuses(numgroups, -1);
+  TPPLPartition serialpp, batchpp;
+  long i;
+
+  for (i = 0; i < numgroups; i++) {
+    groups[i].push_back(MakeSpikyStar(200 + 20 * i));
+    serialstatuses[i] = serialpp.Triangulate_MONO(&groups[i], &serial[i]);
+    CHECK(serialstatuses[i] == 1);
+  }
+
+  batchpp.SetNumThreads(4);
+  CHECK(batchpp.Triangulate_MONO(&groups[0], numgroups, &batch[0], &statuses[0]) == 1);
+  for (i = 0; i < numgroups; i++) {
+    CHECK(statuses[i] == serialstatuses[i]);
+    CHECK(SameTriangles(&batch[i], &serial[i]));
+  }
+}
+
+// Vertex of an interleaved vertex buffer, read through a TPPLPointRange.
+struct Vertex {
+  float u, v;
+  tppl_coord x, y;
+  uint32_t color;
+};
+
+// The range overload of Triangulate_Auto takes the same path as the
+// TPPLPoly one, so it gives the same triangles: a fan for the convex
+// polygon, ear clipping for the small one and Triangulate_MONO for the
+// large one.
+static void TestAutoRangeMatchesPoly() {
+  static const tppl_coord convex[] = {
+    0, 0, 10, 0, 14, 6, 8, 12, 1, 9
+  };
+  static const tppl_coord small[] = {
+    0, 0, 10, 0, 10, 10, 5, 2, 0, 10
+  };
+  TPPLPoly polys[3];
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> polyindices, rangeindices;
+  long polynumtriangles, rangenumtriangles, numpoints;
+  TPPLPartition pp;
+  long i, j;
+
+  polys[0] = MakePoly(convex, 5, false);
+  polys[1] = MakePoly(small, 5, false);
+  polys[2] = MakeSpikyStar(300);
+  for (i = 0; i < 3; i++) {
+    numpoints = polys[i].GetNumPoints();
+    vertices.assign(numpoints, Vertex());
+    for (j = 0; j < numpoints; j++) {
+      vertices[j].x = polys[i][j].x;
+      vertices[j].y = polys[i][j].y;
+    }
+    polyindices.assign(3 * (numpoints - 2), 0);
+    rangeindices.assign(3 * (numpoints - 2), 0);
+
+    CHECK(pp.Triangulate_Auto(&polys[i], &polyindices[0], &polynumtriangles) == 1);
+    CHECK(pp.Triangulate_Auto(TPPLPointRange<Vertex>(&vertices[0], numpoints), &rangeindices[0], &rangenumtriangles) == 1);
+    CHECK(polynumtriangles == numpoints - 2);
+    CHECK(rangenumtriangles == polynumtriangles);
+    CHECK(rangeindices == polyindices);
+  }
+}
+
+// Exposes the thread pool of TPPLPartition.
+class ThreadPoolPartition : public TPPLPartition {
+  public:
+  // Calls Run from inside the tasks of another Run on the same pool and
+  // checks every index of both runs is visited once, on the thread of the
+  // outer task.
+  bool RunNested(long numthreads, long count) {
+    struct Inner {
+      long outerthread;
+      long *visits;
+      long numotherthreads;
+
+      void operator()(long begin, long end, long thread) {
+        long i;
+        for (i = begin; i < end; i++) {
+          visits[i]++;
+        }
+        if (thread != outerthread) {
+          numotherthreads++;
+        }
+      }
+    };
+    struct Outer {
+      ThreadPool *threadpool;
+      long count;
+      long *visits;
+      long *numotherthreads;
+
+      void operator()(long begin, long end, long thread) {
+        Inner inner;
+        long i;
+        for (i = begin; i < end; i++) {
+          inner.outerthread = thread;
+          inner.visits = &visits[i * count];
+          inner.numotherthreads = 0;
+          threadpool->Run(count, 1, inner);
+          numotherthreads[i] = inner.numotherthreads;
+        }
+      }
+    } outer;
+    std::vector<long> visits(count * count, 0);
+    std::vector<long> numotherthreads(count);
+    bool ok;
+    long i;
+
+    threadpool.SetNumThreads(numthreads);
+    outer.threadpool = &threadpool;
+    outer.count = count;
+    outer.visits = &visits[0];
+    outer.numotherthreads = &numotherthreads[0];
+    threadpool.Run(count, 1, outer);
+
+    ok = true;
+    for (i = 0; i < count * count; i++) {
+      ok = ok && (visits[i] == 1);
+    }
+    for (i = 0; i < count; i++) {
+      ok = ok && (numotherthreads[i] == 0);
+    }
+    return ok;
+  }
+};
+
+static void TestThreadPoolNestedRun() {
+  ThreadPoolPartition pp;
+
+  CHECK(pp.RunNested(1, 50));
+  CHECK(pp.RunNested(4, 50));
+  CHECK(pp.RunNested(8, 200));
+}
+
+#ifndef TPPL_USE_INT32
+// Points (0.5 + x * u, 0.5 + y * u), u being half the machine epsilon of
+// tppl_coord, are just off the line through (12, 12) and (24, 24), on the
+// side given by the sign of y - x. Evaluated in tppl_coord arithmetic, the
+// determinant gets many of these signs wrong, see Kettner et al.,
+// "Classroom examples of robustness problems in geometric computations".
+static void TestOrientationNearlyCollinear() {
+  const tppl_coord u = std::numeric_limits<tppl_coord>::epsilon() / 2;
+  TPPLPoint p1, p2, p3;
+  tppl_coord det;
+  long x, y, numwrong;
+  int expected;
+  bool exact;
+
+  p2.x = 12;
+  p2.y = 12;
+  p3.x = 24;
+  p3.y = 24;
+  numwrong = 0;
+  exact = true;
+  for (y = 0; y < 64; y++) {
+    for (x = 0; x < 64; x++) {
+      p1.x = (tppl_coord)0.5 + (tppl_coord)x * u;
+      p1.y = (tppl_coord)0.5 + (tppl_coord)y * u;
+      expected = (y > x) ? 1 : ((y < x) ? -1 : 0);
+
+      det = (p3.y - p1.y) * (p2.x - p1.x) - (p3.x - p1.x) * (p2.y - p1.y);
+      if ((det > 0 ? 1 : (det < 0 ? -1 : 0)) != expected) {
+        numwrong++;
+      }
+
+      exact = exact && (TestPartition::Orientation(p1, p2, p3) == expected) &&
+              (TestPartition::Orientation(p2, p3, p1) == expected) &&
+              (TestPartition::Orientation(p3, p2, p1) == -expected) &&
+              (TestPartition::OrientationExact(p1, p2, p3) == expected) &&
+              (TestPartition::OrientationExact(p2, p1, p3) == -expected);
+    }
+  }
+  CHECK(numwrong > 0);
+  CHECK(exact);
+}
+#endif
+
+#ifdef TPPL_SIMD
+// Vertex with other data around its point, as ClassifyVertices gets them.
+struct StridedVertex {
+  long before;
+  TPPLPoint p;
+  long after;
+};
+
+// Random coordinate on a small grid, so that many points are in line or
+// equal, or just next to a grid value.
+static tppl_coord RandomGridCoord(std::mt19937 &rng) {
+  tppl_coord value = (tppl_coord)(rng() % 9);
+  switch (rng() % 4) {
+    case 0:
+      return nextafter(value, (tppl_coord)100);
+    case 1:
+      return nextafter(value, (tppl_coord)-100);
+    default:
+      return value;
+  }
+}
+
+// The SSE2 and AVX blocks of ClassifyVertices and AnyPointInside must give
+// what the scalar code gives, for points in line, on triangle edges and
+// one unit in the last place off them. Both paths run whatever the CPU
+// would pick, AVX only if it has it.
+static void TestSIMDMatchesScalar() {
+  std::mt19937 rng(18);
+  std::vector<StridedVertex> vertices;
+  std::vector<signed char> orientations;
+  std::vector<tppl_coord> xs, ys;
+  TPPLPoint corners[3], p;
+  long iteration, numpoints, path, first, i, k, firstinside, end;
+  bool same;
+  TestPartition pp;
+
+  for (iteration = 0; iteration < 2000; iteration++) {
+    numpoints = 3 + iteration % 40;
+    vertices.resize(numpoints);
+    orientations.assign(numpoints, 2);
+    for (i = 0; i < numpoints; i++) {
+      vertices[i].p.x = RandomGridCoord(rng);
+      vertices[i].p.y = RandomGridCoord(rng);
+      if (iteration % 2) {
+        // Nearly collinear, beyond the filter.
+        vertices[i].p.x = (tppl_coord)0.5 + (tppl_coord)(rng() % 8) * std::numeric_limits<tppl_coord>::epsilon();
+        vertices[i].p.y = (tppl_coord)0.5 + (tppl_coord)(rng() % 8) * std::numeric_limits<tppl_coord>::epsilon();
+        if (i % 3 == 0) {
+          vertices[i].p.x = vertices[i].p.y = (tppl_coord)(12 * (i % 2 + 1));
+        }
+      }
+    }
+    for (path = 0; path < 2; path++) {
+      if ((path == 1) && !TestPartition::HasAVX()) {
+        continue;
+      }
+      if (path == 0) {
+        first = TestPartition::ClassifyVerticesSSE2(&vertices[0].p, sizeof(StridedVertex), numpoints, &orientations[0]);
+      } else {
+        first = TestPartition::ClassifyVerticesAVX(&vertices[0].p, sizeof(StridedVertex), numpoints, &orientations[0]);
+      }
+      same = (first >= 1) && (first <= numpoints);
+      for (i = 1; same && (i < first); i++) {
+        same = (orientations[i] == TestPartition::Orientation(vertices[i - 1].p, vertices[i].p, vertices[(i + 1) % numpoints].p));
+      }
+      CHECK(same);
+    }
+  }
+
+  for (iteration = 0; iteration < 20000; iteration++) {
+    for (k = 0; k < 3; k++) {
+      corners[k].x = (tppl_coord)(2 * (rng() % 5));
+      corners[k].y = (tppl_coord)(2 * (rng() % 5));
+    }
+    if (TestPartition::Orientation(corners[0], corners[1], corners[2]) <= 0) {
+      continue;
+    }
+    numpoints = 1 + iteration % 13;
+    xs.resize(numpoints);
+    ys.resize(numpoints);
+    for (i = 0; i < numpoints; i++) {
+      switch (rng() % 4) {
+        case 0:
+          // A corner.
+          k = rng() % 3;
+          xs[i] = corners[k].x;
+          ys[i] = corners[k].y;
+          break;
+        case 1:
+          // The middle of an edge, or next to it.
+          k = rng() % 3;
+          xs[i] = (corners[k].x + corners[(k + 1) % 3].x) / 2;
+          ys[i] = (corners[k].y + corners[(k + 1) % 3].y) / 2;
+          if (rng() % 2) {
+            xs[i] = nextafter(xs[i], (tppl_coord)((rng() % 2) ? 100 : -100));
+          }
+          break;
+        default:
+          xs[i] = RandomGridCoord(rng);
+          ys[i] = RandomGridCoord(rng);
+          break;
+      }
+    }
+
+    firstinside = numpoints;
+    for (i = numpoints - 1; i >= 0; i--) {
+      p.x = xs[i];
+      p.y = ys[i];
+      if (!(p == corners[0]) && !(p == corners[1]) && !(p == corners[2]) && pp.IsInside(corners[0], corners[1], corners[2], p)) {
+        firstinside = i;
+      }
+    }
+    for (path = 0; path < 2; path++) {
+      if ((path == 1) && !TestPartition::HasAVX()) {
+        continue;
+      }
+      if (path == 0) {
+        first = pp.FindPointInsideSSE2(corners[0], corners[1], corners[2], &xs[0], &ys[0], numpoints);
+        end = numpoints - numpoints % 2;
+      } else {
+        first = pp.FindPointInsideAVX(corners[0], corners[1], corners[2], &xs[0], &ys[0], numpoints);
+        end = numpoints - numpoints % 4;
+      }
+      CHECK(first == ((firstinside < end) ? -1 : end));
+    }
+  }
+}
+#endif
+
+// Coordinates near +-2^31 make the products of the orientation determinant
+// overflow 64 bits in TPPL_USE_INT32 mode, and need the exact fallback in
+// double mode. Float mode gets the nearest values it can represent.
+static void TestOrientationLargeCoordinates() {
+#ifdef TPPL_USE_FLOAT
+  const tppl_coord unit = 128;
+#else
+  const tppl_coord unit = 1;
+#endif
+  const tppl_coord m = (tppl_coord)(2147483647 - 127 * (long)unit);
+  TPPLPoint p1, p2, p3;
+
+  p1.x = -m;
+  p1.y = -m;
+  p2.x = m;
+  p2.y = m;
+
+  // Just left of, just right of and on the diagonal.
+  p3.x = m - unit;
+  p3.y = m;
+  CHECK(TestPartition::Orientation(p1, p2, p3) == 1);
+  p3.x = m;
+  p3.y = m - unit;
+  CHECK(TestPartition::Orientation(p1, p2, p3) == -1);
+  p3.x = -m + 2 * unit;
+  p3.y = -m + 2 * unit;
+  CHECK(TestPartition::Orientation(p1, p2, p3) == 0);
+  CHECK(TestPartition::Orientation(p2, p1, p3) == 0);
+
+  // Corners of the full range, the determinant itself is above 2^63.
+  p1.x = -m;
+  p1.y = -m;
+  p2.x = m;
+  p2.y = -m;
+  p3.x = -m;
+  p3.y = m;
+  CHECK(TestPartition::Orientation(p1, p2, p3) == 1);
+  CHECK(TestPartition::Orientation(p1, p3, p2) == -1);
+
+  // Anti-diagonal, the other quadrant pair.
+  p1.x = -m;
+  p1.y = m;
+  p2.x = m;
+  p2.y = -m;
+  p3.x = unit;
+  p3.y = 0;
+  CHECK(TestPartition::Orientation(p1, p2, p3) == 1);
+  p3.x = 0;
+  p3.y = -unit;
+  CHECK(TestPartition::Orientation(p1, p2, p3) == -1);
+  p3.x = 0;
+  p3.y = 0;
+  CHECK(TestPartition::Orientation(p1, p2, p3) == 0);
+
+#ifdef TPPL_USE_INT32
+  {
+    // x * x - (x + 1) * (x - 1) is 1, both products are above 2^63.
+    const int64_t x = ((int64_t)1 << 32) - 2;
+    CHECK(TestPartition::ProductDifferenceSign(x, x, x + 1, x - 1) == 1);
+    CHECK(TestPartition::ProductDifferenceSign(x + 1, x - 1, x, x) == -1);
+    CHECK(TestPartition::ProductDifferenceSign(x, x + 1, x + 1, x) == 0);
+    CHECK(TestPartition::ProductDifferenceSign(-x, x, -(x + 1), x - 1) == -1);
+    CHECK(TestPartition::ProductDifferenceSign(-x, -x, x - 1, x + 1) == 1);
+    CHECK(TestPartition::ProductDifferenceSign(-x, x, x, -x) == 0);
+    CHECK(TestPartition::ProductDifferenceSign(x, 0, -x, x) == 1);
+    CHECK(TestPartition::ProductDifferenceSign(x, x, -x, x) == 1);
+    CHECK(TestPartition::ProductDifferenceSign(-x, x, x, x) == -1);
+  }
+#endif
+}
+
+// Once the scratch memory fits the input, the indexed overloads make no
+// heap allocations at all, and the list overloads only allocate their output.
+static void TestNoAllocationsAfterWarmUp() {
+  TPPLPoly poly, small;
+  TPPLPolyList polys, parts;
+  std::vector<uint32_t> indices;
+  long numtriangles, allocationcount, heapallocations, round;
+  TPPLPartition pp;
+
+  poly = MakeSpikyStar(200);
+  small = MakeSpikyStar(40);
+  polys.push_back(poly);
+  indices.assign(3 * 200, 0);
+
+  for (round = 0; round < 4; round++) {
+    allocationcount = pp.GetAllocationCount();
+
+    heapallocations = numheapallocations;
+    CHECK(pp.Triangulate_EC(&poly, &indices[0], &numtriangles) == 1);
+    CHECK(pp.Triangulate_MONO(&poly, &indices[0], &numtriangles) == 1);
+    CHECK(pp.Triangulate_OPT(&small, &indices[0], &numtriangles) == 1);
+    if (round > 0) {
+      CHECK(numheapallocations == heapallocations);
+    }
+
+    parts.clear();
+    heapallocations = numheapallocations;
+    CHECK(pp.MonotonePartition(&polys, &parts) == 1);
+    if (round > 0) {
+      CHECK(numheapallocations - heapallocations <= 2 * (long)parts.size());
+    }
+
+    parts.clear();
+    heapallocations = numheapallocations;
+    CHECK(pp.ConvexPartition_OPT(&small, &parts) == 1);
+    if (round > 0) {
+      CHECK(numheapallocations - heapallocations <= 2 * (long)parts.size());
+      CHECK(pp.GetAllocationCount() == allocationcount);
+    }
+  }
+}
+
+// Visibility of each pair of vertices checked against every edge, the way
+// Triangulate_OPT used to.
+static bool VisibilityMatchesBruteForce(TestPartition *pp, TPPLPoly *poly, const TPPLVisibility *visibility) {
+  long n, i, j, k;
+  bool visible;
+
+  n = poly->GetNumPoints();
+  for (i = 0; i < n; i++) {
+    for (j = i + 1; j < n; j++) {
+      if ((j == (i + 1)) || ((i == 0) && (j == (n - 1)))) {
+        visible = true;
+      } else {
+        visible = pp->InCone(poly->GetPoint((i + n - 1) % n), poly->GetPoint(i), poly->GetPoint((i + 1) % n), poly->GetPoint(j)) &&
+                pp->InCone(poly->GetPoint((j + n - 1) % n), poly->GetPoint(j), poly->GetPoint((j + 1) % n), poly->GetPoint(i));
+        for (k = 0; visible && (k < n); k++) {
+          if (pp->Intersects(poly->GetPoint(i), poly->GetPoint(j), poly->GetPoint(k), poly->GetPoint((k + 1) % n))) {
+            visible = false;
+          }
+        }
+      }
+      if (visibility->IsVisible(i, j) != visible) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Comb of numteeth teeth of random heights on a base with a vertex at every
+// integer x, so that many vertices and edges are in line with each other.
+static TPPLPoly MakeComb(std::mt19937 &rng, long numteeth) {
+  std::uniform_int_distribution<int> height(2, 5);
+  std::vector<tppl_coord> coords;
+  long t;
+  tppl_coord h;
+
+  for (t = 0; t <= 2 * numteeth; t++) {
+    coords.push_back((tppl_coord)t);
+    coords.push_back(0);
+  }
+  for (t = numteeth - 1; t >= 0; t--) {
+    h = (tppl_coord)height(rng);
+    coords.push_back((tppl_coord)(2 * t + 2));
+    coords.push_back(h);
+    coords.push_back((tppl_coord)(2 * t + 1));
+    coords.push_back(h);
+    coords.push_back((tppl_coord)(2 * t + 1));
+    coords.push_back(1);
+    coords.push_back((tppl_coord)(2 * t));
+    coords.push_back(1);
+  }
+  return MakePoly(&coords[0], (long)coords.size() / 2, false);
+}
+
+// ComputeVisibility matches checking every pair of vertices against every
+// edge on random star polygons, the same with a vertex added in the middle
+// of some edges, and combs full of collinear vertices.
+static void TestVisibilityMatchesBruteForce() {
+  std::mt19937 rng(7);
+  TPPLPoly star, poly;
+  TPPLVisibility visibility;
+  long iteration, numpoints, i, j;
+  TestPartition pp;
+
+  for (iteration = 0; iteration < 300; iteration++) {
+    numpoints = 4 + iteration % 100;
+    switch (iteration % 3) {
+      case 0:
+        poly = MakeRandomStar(rng, numpoints, (iteration % 2) ? 9000 : 2000, 10000);
+        break;
+      case 1:
+        star = MakeRandomStar(rng, numpoints, 2000, 10000);
+        poly.Init(numpoints + (numpoints + 2) / 3);
+        j = 0;
+        for (i = 0; i < numpoints; i++) {
+          poly[(int)j].x = 2 * star[(int)i].x;
+          poly[(int)j++].y = 2 * star[(int)i].y;
+          if (i % 3 == 0) {
+            poly[(int)j].x = star[(int)i].x + star[(int)((i + 1) % numpoints)].x;
+            poly[(int)j++].y = star[(int)i].y + star[(int)((i + 1) % numpoints)].y;
+          }
+        }
+        break;
+      default:
+        poly = MakeComb(rng, 1 + numpoints / 6);
+        break;
+    }
+    CHECK(pp.ComputeVisibility(&poly, &visibility) == 1);
+    CHECK(VisibilityMatchesBruteForce(&pp, &poly, &visibility));
+  }
+}
+
+// Sets the points of poly to numpoints points numbered from first.
+static void FillPoly(TPPLPoly *poly, long numpoints, long first) {
+  long i;
+
+  poly->Init(numpoints);
+  for (i = 0; i < numpoints; i++) {
+    poly->GetPoint(i).x = (tppl_coord)(first + i);
+    poly->GetPoint(i).y = (tppl_coord)(2 * (first + i));
+    poly->GetPoint(i).id = (int)(first + i);
+  }
+}
+
+static bool HasPoints(const TPPLPoly &poly, long numpoints, long first) {
+  long i;
+
+  if (poly.GetNumPoints() != numpoints) {
+    return false;
+  }
+  for (i = 0; i < numpoints; i++) {
+    if ((poly.GetPoint(i).x != (tppl_coord)(first + i)) || (poly.GetPoint(i).y != (tppl_coord)(2 * (first + i))) ||
+            (poly.GetPoint(i).id != (int)(first + i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Whether the points of poly are stored inside the object.
+static bool HasInlinePoints(TPPLPoly *poly) {
+  char *points = (char *)poly->GetPoints();
+  return (points >= (char *)poly) && (points < (char *)(poly + 1));
+}
+
+// Polygons of up to four points keep them inline. Copying and moving must
+// keep the points, whichever storage the source and the target use, also
+// after Init has shrunk a polygon from heap to inline points. Moving heap
+// points takes them over, moving inline points copies them, and neither
+// allocates.
+static void TestPolyCopyAndMove() {
+  static const long sizes[] = {3, 4, 5};
+  static const long targetsizes[] = {0, 3, 4, 5, 8};
+  long size, target, numallocations;
+  TPPLPoint *points;
+  TPPLPoly src, dst, shrunk;
+
+  for (size = 0; size < 3; size++) {
+    for (target = 0; target < 5; target++) {
+      // Copy construction and assignment.
+      FillPoly(&src, sizes[size], 10);
+      src.SetHole(true);
+      TPPLPoly copy(src);
+      CHECK(HasPoints(copy, sizes[size], 10) && copy.IsHole());
+      CHECK(HasInlinePoints(&copy) == (sizes[size] <= 4));
+      FillPoly(&dst, targetsizes[target], 100);
+      dst = src;
+      CHECK(HasPoints(dst, sizes[size], 10) && dst.IsHole());
+      CHECK(HasInlinePoints(&dst) == (sizes[size] <= 4));
+      src.GetPoint(0).x = -1;
+      CHECK(copy.GetPoint(0).x == 10);
+      CHECK(dst.GetPoint(0).x == 10);
+      TPPLPoly &self = dst;
+      dst = self;
+      CHECK(HasPoints(dst, sizes[size], 10));
+
+      // Move construction.
+      FillPoly(&src, sizes[size], 20);
+      src.SetHole(true);
+      points = src.GetPoints();
+      numallocations = numheapallocations;
+      TPPLPoly moved(std::move(src));
+      CHECK(numheapallocations == numallocations);
+      CHECK(HasPoints(moved, sizes[size], 20) && moved.IsHole());
+      CHECK((moved.GetPoints() == points) == (sizes[size] > 4));
+      CHECK(HasInlinePoints(&moved) == (sizes[size] <= 4));
+      CHECK((src.GetNumPoints() == 0) && !src.IsHole());
+
+      // Move assignment.
+      FillPoly(&src, sizes[size], 30);
+      FillPoly(&dst, targetsizes[target], 100);
+      points = src.GetPoints();
+      numallocations = numheapallocations;
+      dst = std::move(src);
+      CHECK(numheapallocations == numallocations);
+      CHECK(HasPoints(dst, sizes[size], 30));
+      CHECK((dst.GetPoints() == points) == (sizes[size] > 4));
+      CHECK(src.GetNumPoints() == 0);
+
+      // Shrinking from heap to inline points, then copying and moving.
+      FillPoly(&shrunk, 5 + targetsizes[target], 200);
+      FillPoly(&shrunk, sizes[size], 40);
+      CHECK(HasInlinePoints(&shrunk) == (sizes[size] <= 4));
+      dst = shrunk;
+      CHECK(HasPoints(dst, sizes[size], 40));
+      TPPLPoly movedshrunk(std::move(shrunk));
+      CHECK(HasPoints(movedshrunk, sizes[size], 40));
+      CHECK(shrunk.GetNumPoints() == 0);
+      FillPoly(&src, targetsizes[target], 300);
+      src = std::move(movedshrunk);
+      CHECK(HasPoints(src, sizes[size], 40));
+      CHECK(movedshrunk.GetNumPoints() == 0);
+    }
+  }
+}
+
+// From 256 vertices on, SortVertices radix sorts the y coordinates and
+// only sorts runs of equal y by x. The order must be the one VertexSorter
+// gives, for few distinct y values, for zeros of both signs, and for
+// coordinates at the ends of the range.
+static void TestSortVerticesMatchesSorter() {
+  static const long sizes[] = {255, 256, 257, 1000, 4096};
+#ifdef TPPL_USE_INT32
+  static const tppl_coord extremes[] = {-2147483647 - 1, -2147483647, -65536, -256, -1, 0, 1, 255, 256, 65536, 2147483647};
+#else
+  static const tppl_coord extremes[] = {-1e30f, -65536.5f, -256, -1, -0.0f, 0, 0.5f, 1, 255, 256, 1e30f};
+#endif
+  const long numextremes = sizeof(extremes) / sizeof(extremes[0]);
+  std::mt19937 rng(11);
+  std::vector<TestPartition::MonotoneVertex> vertices;
+  std::vector<long> priority, expected;
+  long size, variant, i;
+  bool same;
+  TestPartition pp;
+
+  for (size = 0; size < (long)(sizeof(sizes) / sizeof(sizes[0])); size++) {
+    for (variant = 0; variant < 3; variant++) {
+      vertices.resize(sizes[size]);
+      priority.resize(sizes[size]);
+      for (i = 0; i < sizes[size]; i++) {
+        switch (variant) {
+          case 0:
+            vertices[i].p.x = (tppl_coord)(rng() % 5);
+            vertices[i].p.y = (tppl_coord)((long)(rng() % 9) - 4);
+            break;
+          case 1:
+            vertices[i].p.x = extremes[rng() % numextremes];
+            vertices[i].p.y = extremes[rng() % numextremes];
+            break;
+          default:
+            vertices[i].p.x = (tppl_coord)((long)(rng() % 20001) - 10000);
+            vertices[i].p.y = (tppl_coord)((long)(rng() % 20001) - 10000);
+            break;
+        }
+        priority[i] = i;
+      }
+      std::shuffle(priority.begin(), priority.end(), rng);
+      expected = priority;
+      std::sort(expected.begin(), expected.end(), TestPartition::VertexSorter(&vertices[0]));
+      pp.SortVertices(&vertices[0], &priority[0], sizes[size]);
+
+      // Equal points may come in any order.
+      same = true;
+      for (i = 0; i < sizes[size]; i++) {
+        same = same && (vertices[priority[i]].p == vertices[expected[i]].p);
+      }
+      CHECK(same);
+      std::sort(priority.begin(), priority.end());
+      same = true;
+      for (i = 0; i < sizes[size]; i++) {
+        same = same && (priority[i] == i);
+      }
+      CHECK(same);
+    }
+  }
+}
+
+// Checks that poly is counter-clockwise and y-monotone, that is has one
+// highest vertex and one lowest in the order of TPPLPartition::Below.
+static bool IsYMonotone(TPPLPoly &poly) {
+  long n, i, numtops, numbottoms;
+  TPPLPoint *previous, *current, *next;
+
+  n = poly.GetNumPoints();
+  if ((n < 3) || (TwiceArea(poly) <= 0)) {
+    return false;
+  }
+  numtops = 0;
+  numbottoms = 0;
+  for (i = 0; i < n; i++) {
+    previous = &poly[(int)((i + n - 1) % n)];
+    current = &poly[(int)i];
+    next = &poly[(int)((i + 1) % n)];
+    if ((*current == *previous) || (*current == *next)) {
+      return false;
+    }
+    if ((previous->y < current->y || (previous->y == current->y && previous->x < current->x)) &&
+            (next->y < current->y || (next->y == current->y && next->x < current->x))) {
+      numtops++;
+    }
+    if ((current->y < previous->y || (current->y == previous->y && current->x < previous->x)) &&
+            (current->y < next->y || (current->y == next->y && current->x < next->x))) {
+      numbottoms++;
+    }
+  }
+  return (numtops == 1) && (numbottoms == 1);
+}
+
+// MonotonePartition splits random polygons, with and without holes, into
+// y-monotone pieces covering their area. Built with
+// -DTPPL_SCANLINE_SKIPLIST, this tests the skip list holding the edges
+// crossing the scanline.
+static void TestMonotonePieces() {
+  std::mt19937 rng(10);
+  TPPLPolyList polys, pieces;
+  TPPLPolyList::iterator iter;
+  long iteration;
+  double area, piecesarea;
+  bool monotone;
+  TPPLPartition pp;
+
+  for (iteration = 0; iteration < 300; iteration++) {
+    if (iteration % 2) {
+      polys.clear();
+      polys.push_back(MakeRandomStar(rng, 3 + iteration, 1000, 10000));
+      area = TwiceArea(polys.front());
+    } else {
+      area = MakeStarWithHoles(rng, 12 + iteration % 100, iteration % 4, 3 + iteration % 9, &polys);
+    }
+    pieces.clear();
+    CHECK(pp.MonotonePartition(&polys, &pieces) == 1);
+    piecesarea = 0;
+    monotone = true;
+    for (iter = pieces.begin(); iter != pieces.end(); iter++) {
+      monotone = monotone && IsYMonotone(*iter);
+      piecesarea += TwiceArea(*iter);
+    }
+    CHECK(monotone);
+    CHECK(piecesarea == area);
+  }
+}
+
+// With more than one thread, Triangulate_OPT fills its tables one
+// wavefront of equally long diagonals at a time, split into chunks of
+// 1 + 4096 / gap diagonals. The polygons are large enough to split the
+// wavefronts, and the triangles must be exactly those of one thread.
+static void TestOPTParallelMatchesSerial() {
+  std::mt19937 rng(6);
+  std::vector<uint32_t> serial, parallel;
+  TPPLPoly poly;
+  long serialnumtriangles, numtriangles, iteration, numpoints;
+  TPPLPartition serialpp, parallelpp;
+
+  parallelpp.SetNumThreads(4);
+  for (iteration = 0; iteration < 200; iteration++) {
+    numpoints = 100 + iteration;
+    poly = MakeRandomStar(rng, numpoints, (iteration % 2) ? 9000 : 2000, 10000);
+    serial.assign(3 * numpoints, 0);
+    parallel.assign(3 * numpoints, 0);
+    CHECK(serialpp.Triangulate_OPT(&poly, &serial[0], &serialnumtriangles) == 1);
+    CHECK(parallelpp.Triangulate_OPT(&poly, &parallel[0], &numtriangles) == 1);
+    CHECK(numtriangles == serialnumtriangles);
+    CHECK(parallel == serial);
+  }
+}
+
+// Triangulate_ECZ gives n - 2 triangles covering the polygon, with or
+// without clipping the most extruded ear first. Polygons made by
+// RemoveHoles visit the bridge vertices twice, so vertices share positions
+// there. On convex input, clipping the most extruded ear first clips the
+// same ears as Triangulate_EC.
+static void TestECZ() {
+  std::mt19937 rng(3);
+  std::vector<uint32_t> indices, ecindices;
+  TPPLPolyList polys, holeless;
+  TPPLPoly poly;
+  long numtriangles, ecnumtriangles, iteration, numpoints;
+  double area;
+  TPPLPartition pp;
+
+  for (iteration = 0; iteration < 300; iteration++) {
+    numpoints = 3 + iteration % 150;
+    poly = MakeRandomStar(rng, numpoints, 2000, 10000);
+    indices.assign(3 * numpoints, 0);
+    CHECK(pp.Triangulate_ECZ(&poly, &indices[0], &numtriangles) == 1);
+    CHECK(IsTriangulation(poly, TwiceArea(poly), &indices[0], numtriangles));
+    CHECK(pp.Triangulate_ECZ(&poly, &indices[0], &numtriangles, true) == 1);
+    CHECK(IsTriangulation(poly, TwiceArea(poly), &indices[0], numtriangles));
+  }
+
+  for (iteration = 0; iteration < 100; iteration++) {
+    holeless.clear();
+    area = MakeStarWithHoles(rng, 12 + iteration % 40, 1 + iteration % 3, 3 + iteration % 7, &polys);
+    CHECK(pp.RemoveHoles(&polys, &holeless) == 1);
+    CHECK(holeless.size() == 1);
+    poly = holeless.front();
+    indices.assign(3 * poly.GetNumPoints(), 0);
+    CHECK(pp.Triangulate_ECZ(&poly, &indices[0], &numtriangles) == 1);
+    CHECK(IsTriangulation(poly, area, &indices[0], numtriangles));
+    CHECK(pp.Triangulate_ECZ(&poly, &indices[0], &numtriangles, true) == 1);
+    CHECK(IsTriangulation(poly, area, &indices[0], numtriangles));
+  }
+
+  for (iteration = 0; iteration < 100; iteration++) {
+    numpoints = 3 + iteration % 60;
+    poly = MakeRandomStar(rng, numpoints, 10000, 10000);
+    CHECK(poly.GetOrientation() == TPPL_ORIENTATION_CCW);
+    indices.assign(3 * numpoints, 0);
+    ecindices.assign(3 * numpoints, 0);
+    CHECK(pp.Triangulate_ECZ(&poly, &indices[0], &numtriangles, true) == 1);
+    CHECK(pp.Triangulate_EC(&poly, &ecindices[0], &ecnumtriangles) == 1);
+    CHECK(numtriangles == ecnumtriangles);
+    CHECK(indices == ecindices);
+  }
+}
+
+static TPPLPoly MakeRect(tppl_coord x1, tppl_coord y1, tppl_coord x2, tppl_coord y2, bool hole) {
+  tppl_coord coords[8];
+  TPPLPoly poly;
+
+  coords[0] = x1;
+  coords[1] = y1;
+  coords[2] = x2;
+  coords[3] = y1;
+  coords[4] = x2;
+  coords[5] = y2;
+  coords[6] = x1;
+  coords[7] = y2;
+  poly = MakePoly(coords, 4, false);
+  if (hole) {
+    poly.Invert();
+    poly.SetHole(true);
+  }
+  return poly;
+}
+
+// Checks that RemoveHoles and RemoveHoles_Grid both give one polygon of
+// n + 2h vertices with twice the area left by the holes.
+static bool RemovesHolesLikeRemoveHoles(TPPLPolyList *polys, double area) {
+  TPPLPolyList holeless, gridholeless;
+  TPPLPolyList::iterator iter;
+  long numpoints;
+  TPPLPartition pp;
+
+  numpoints = 0;
+  for (iter = polys->begin(); iter != polys->end(); iter++) {
+    numpoints += iter->GetNumPoints() + (iter->IsHole() ? 2 : 0);
+  }
+  if (!pp.RemoveHoles(polys, &holeless) || !pp.RemoveHoles_Grid(polys, &gridholeless)) {
+    return false;
+  }
+  if ((holeless.size() != 1) || (gridholeless.size() != 1)) {
+    return false;
+  }
+  return (holeless.front().GetNumPoints() == numpoints) && (gridholeless.front().GetNumPoints() == numpoints) &&
+          (TwiceArea(holeless.front()) == area) && (TwiceArea(gridholeless.front()) == area);
+}
+
+// RemoveHoles_Grid cuts the same bridges as RemoveHoles: on random stars
+// with many holes, where Triangulate_EC and ConvexPartition_HM on the hole
+// list must also cover the area left, on rows of square holes whose bridges
+// run through vertices of other holes and of the outer polygon, on holes
+// touching at a vertex and on holes sharing their rightmost vertex.
+static void TestRemoveHolesGrid() {
+  std::mt19937 rng(21);
+  TPPLPolyList polys, triangles, parts;
+  TPPLPolyList::iterator iter;
+  TPPLPoly hole;
+  long iteration, numholes, numpoints, i, j, k;
+  double area, sum;
+  TPPLPartition pp;
+
+  for (iteration = 0; iteration < 50; iteration++) {
+    numholes = 1 + iteration % 8;
+    polys.clear();
+    polys.push_back(MakeRect(0, 0, 1000 * numholes, 1000 * numholes, false));
+    area = TwiceArea(polys.front());
+    numpoints = 4;
+    for (i = 0; i < numholes; i++) {
+      for (j = 0; j < numholes; j++) {
+        hole = MakeRandomStar(rng, 3 + (i + j + iteration) % 20, 100, 400);
+        for (k = 0; k < hole.GetNumPoints(); k++) {
+          hole[(int)k].x += 500 + 1000 * (tppl_coord)i;
+          hole[(int)k].y += 500 + 1000 * (tppl_coord)j;
+        }
+        area -= TwiceArea(hole);
+        numpoints += hole.GetNumPoints() + 2;
+        hole.Invert();
+        hole.SetHole(true);
+        polys.push_back(hole);
+      }
+    }
+    CHECK(RemovesHolesLikeRemoveHoles(&polys, area));
+
+    triangles.clear();
+    CHECK(pp.Triangulate_EC(&polys, &triangles) == 1);
+    CHECK((long)triangles.size() == numpoints - 2);
+    sum = 0;
+    for (iter = triangles.begin(); iter != triangles.end(); iter++) {
+      CHECK(TwiceArea(*iter) >= 0);
+      sum += TwiceArea(*iter);
+    }
+    CHECK(sum == area);
+
+    parts.clear();
+    CHECK(pp.ConvexPartition_HM(&polys, &parts) == 1);
+    sum = 0;
+    for (iter = parts.begin(); iter != parts.end(); iter++) {
+      sum += TwiceArea(*iter);
+    }
+    CHECK(sum == area);
+  }
+
+  polys.clear();
+  polys.push_back(MakeRect(0, 0, 100, 100, false));
+  area = 2 * 100 * 100;
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 4; j++) {
+      polys.push_back(MakeRect(10 + 20 * (tppl_coord)i, 10 + 20 * (tppl_coord)j, 20 + 20 * (tppl_coord)i,
+              20 + 20 * (tppl_coord)j, true));
+      area -= 2 * 10 * 10;
+    }
+  }
+  CHECK(RemovesHolesLikeRemoveHoles(&polys, area));
+
+  {
+    const tppl_coord outer[] = {0, 0, 100, 0, 100, 50, 90, 50, 90, 60, 100, 60, 100, 100, 0, 100};
+    const tppl_coord hole1[] = {40, 50, 30, 40, 20, 50, 30, 60};
+    const tppl_coord hole2[] = {70, 50, 60, 40, 55, 50, 60, 60};
+
+    polys.clear();
+    polys.push_back(MakePoly(outer, 8, false));
+    polys.push_back(MakePoly(hole1, 4, true));
+    polys.push_back(MakePoly(hole2, 4, true));
+    area = 0;
+    for (iter = polys.begin(); iter != polys.end(); iter++) {
+      area += TwiceArea(*iter);
+    }
+    CHECK(RemovesHolesLikeRemoveHoles(&polys, area));
+  }
+
+  polys.clear();
+  polys.push_back(MakeRect(0, 0, 100, 100, false));
+  area = 2 * 100 * 100;
+  for (i = 0; i < 3; i++) {
+    polys.push_back(MakeRect(10 + 20 * (tppl_coord)i, 10 + 20 * (tppl_coord)i, 30 + 20 * (tppl_coord)i,
+            30 + 20 * (tppl_coord)i, true));
+    area -= 2 * 20 * 20;
+  }
+  CHECK(RemovesHolesLikeRemoveHoles(&polys, area));
+
+  {
+    const tppl_coord outer[] = {0, 0, 100, 0, 100, 100, 0, 100};
+    const tppl_coord hole1[] = {60, 50, 20, 30, 20, 45};
+    const tppl_coord hole2[] = {60, 50, 20, 55, 20, 70};
+
+    polys.clear();
+    polys.push_back(MakePoly(outer, 4, false));
+    polys.push_back(MakePoly(hole1, 3, true));
+    polys.push_back(MakePoly(hole2, 3, true));
+    area = 0;
+    for (iter = polys.begin(); iter != polys.end(); iter++) {
+      area += TwiceArea(*iter);
+    }
+    CHECK(RemovesHolesLikeRemoveHoles(&polys, area));
+  }
+}
+
+int main() {
+  TestOrientationLargeCoordinates();
+#ifdef TPPL_SIMD
+  TestSIMDMatchesScalar();
+#endif
+#ifndef TPPL_USE_INT32
+  TestOrientationNearlyCollinear();
+#endif
+  TestMonoHoleOutsideOuter();
+  TestNoAllocationsAfterWarmUp();
+  TestECZ();
+  TestRemoveHolesGrid();
+  TestPolyCopyAndMove();
+  TestSortVerticesMatchesSorter();
+  TestMonotonePieces();
+  TestMonoBatchMatchesSerial();
+  TestOPTParallelMatchesSerial();
+  TestVisibilityMatchesBruteForce();
+  TestThreadPoolNestedRun();
+  TestAutoRangeMatchesPoly();
+
+  if (numfailures) {
+    printf("%d failures\n", numfailures);
+    return 1;
+  }
+  printf("All tests passed\n");
+  return 0;
+}